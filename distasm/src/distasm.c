@@ -201,6 +201,13 @@ int main(int argc, const char *argv[])
 					val |= b << (j * 8);
 				}
 				if (ret) break;
+
+				// Name known extended operations by their extended opcode
+				const char *ext_name = opcode == op_ext ? name_for_opcode(EXT_OPCODE_BASE + val) : NULL;
+				if (ext_name) {
+					name = ext_name;
+					sdt = SDT_VOID;
+				}
 			}
 
 			// Print address if requested
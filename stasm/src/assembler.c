@@ -26,9 +26,28 @@ static const struct autosym autosyms[] = {
 	{ "BEGIN_INT_ADDR", BEGIN_INT_ADDR },
 	{ "INIT_PC_VAL", INIT_PC_VAL },
 	{ "IO_ASSERT_ADDR", IO_ASSERT_ADDR },
+	{ "IO_CORE_ID_ADDR", IO_CORE_ID_ADDR },
+	{ "IO_CORE_START_ADDR", IO_CORE_START_ADDR },
+	{ "IO_FILE_ADDR_ADDR", IO_FILE_ADDR_ADDR },
+	{ "IO_FILE_LEN_ADDR", IO_FILE_LEN_ADDR },
+	{ "IO_FILE_OFFSET_ADDR", IO_FILE_OFFSET_ADDR },
+	{ "IO_FILE_READ_ADDR", IO_FILE_READ_ADDR },
+	{ "IO_FILE_RESULT_ADDR", IO_FILE_RESULT_ADDR },
+	{ "IO_FILE_SELECT_ADDR", IO_FILE_SELECT_ADDR },
+	{ "IO_FILE_SIZE_ADDR", IO_FILE_SIZE_ADDR },
+	{ "IO_FILE_WRITE_ADDR", IO_FILE_WRITE_ADDR },
 	{ "IO_FLUSH_ADDR", IO_FLUSH_ADDR },
+	{ "IO_MAILBOX_COUNT_ADDR", IO_MAILBOX_COUNT_ADDR },
+	{ "IO_MAILBOX_RECV_ADDR", IO_MAILBOX_RECV_ADDR },
+	{ "IO_MAILBOX_SEND_ADDR", IO_MAILBOX_SEND_ADDR },
+	{ "IO_MAILBOX_SENT_ADDR", IO_MAILBOX_SENT_ADDR },
+	{ "IO_MAILBOX_TARGET_ADDR", IO_MAILBOX_TARGET_ADDR },
+	{ "IO_MAILBOX_WAIT_ADDR", IO_MAILBOX_WAIT_ADDR },
+	{ "IO_NUM_CORES_ADDR", IO_NUM_CORES_ADDR },
 	{ "IO_STDIN_ADDR", IO_STDIN_ADDR },
+	{ "IO_STDIN_READ_ADDR", IO_STDIN_READ_ADDR },
 	{ "IO_STDOUT_ADDR", IO_STDOUT_ADDR },
+	{ "IO_STDOUT_WRITE_ADDR", IO_STDOUT_WRITE_ADDR },
 	{ "IO_URAND_ADDR", IO_URAND_ADDR },
 };
 // Returns a pointer to the autosym struct for the given name, or NULL
@@ -90,7 +109,7 @@ static int symbol_sub(struct assembler *as, struct token *token, bchar **val)
 					}
 					// Attempt to look up opcode
 					int opcode = opcode_for_name(symbuf);
-					if (opcode >= 0) {
+					if (opcode >= 0 && opcode < EXT_OPCODE_BASE) {
 						sprintf(symbuf, "%d", opcode);
 						symbol = bstrdupc(symbuf);
 					}
@@ -468,7 +487,7 @@ static int assembler_handle_opcode(struct assembler *as, bool pseudo_op, int cod
 		return 1;
 	}
 
-	int opcode_size = 1; // For now we assume opcode size is 1 byte
+	int opcode_size = 1; // Bytes before the immediate value
 	int opcode = -1, sdt;
 	if (pseudo_op) {
 		// For pseudo-ops, put the worst-case (max program size) opcode. These may be compacted later.
@@ -584,6 +603,12 @@ static int assembler_handle_opcode(struct assembler *as, bool pseudo_op, int cod
 	// Prepare bytes to write to output file
 	uint8_t buff[9]; // Maximum instruction length is 9 bytes
 	buff[0] = opcode;
+	if (opcode >= EXT_OPCODE_BASE) {
+		// Extended operations are encoded as op_ext followed by the extended opcode
+		buff[0] = op_ext;
+		buff[1] = opcode - EXT_OPCODE_BASE;
+		opcode_size = 2;
+	}
 
 	// Immediate type has already been computed. Get the immediate size.
 	int imm_bytes = sdt_size(sdt);
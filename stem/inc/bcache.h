@@ -0,0 +1,87 @@
+// bcache.h
+//
+// Cache of predecoded blocks of Starch instructions
+
+#pragma once
+
+#include <stdint.h>
+#include "jit.h"
+#include "mem.h"
+
+enum {
+	BCACHE_MAX_INSTS = 64, // Maximum number of instructions in a block
+	BCACHE_NUM_BUCKETS = 0x1000, // Number of hash buckets. Must be a power of two.
+	BCACHE_MAX_BLOCKS = 0x4000, // Number of blocks at which the cache is flushed
+	BCACHE_NUM_LINKS = 2, // Number of successor links per block
+};
+
+// Fused instruction sequences. A sequence is executed by a single handler,
+// installed on the first instruction of the sequence.
+enum {
+	FUSE_NONE,
+	FUSE_PUSHI_LOADPOPSFP8,       // push imm as 64 bit; loadpopsfp8
+	FUSE_PUSHI_LOADPOPSFP16,      // push imm as 64 bit; loadpopsfp16
+	FUSE_PUSHI_LOADPOPSFP32,      // push imm as 64 bit; loadpopsfp32
+	FUSE_PUSHI_LOADPOPSFP64,      // push imm as 64 bit; loadpopsfp64
+	FUSE_PUSHI_ADD64,             // push imm as 64 bit; add64
+	FUSE_PUSHI_SUB64,             // push imm as 64 bit; sub64
+	FUSE_CMP_BRZ64,               // 64 bit comparison; rbrz64
+	FUSE_DUP_PUSHI_CMP_BRZ64,     // dup64; push imm as 64 bit; 64 bit comparison; rbrz64
+	FUSE_DUP_PUSHSFP_CMP_BRZ64,   // dup64; push imm as 64 bit; loadpopsfp64; 64 bit comparison; rbrz64
+	FUSE_COUNT,
+};
+
+// Returns the name of the given fused sequence, or NULL if invalid
+const char *name_for_fuse(int fuse);
+
+// Returns the number of instructions in the given fused sequence, or 0 if invalid
+int fuse_len(int fuse);
+
+// A decoded instruction
+struct dinst {
+	const void *handler; // Execution engine handler for the opcode or fused sequence
+	uint64_t imm; // Immediate argument, sign-extended for signed types
+	uint8_t opcode, len;
+	uint8_t fuse; // Fused sequence beginning with this instruction, or FUSE_NONE
+};
+
+// A straight-line run of decoded instructions. A block ends at an instruction
+// which may transfer control, before an instruction which crosses a page
+// boundary, or at BCACHE_MAX_INSTS instructions.
+struct block {
+	struct block *next; // Next block in the same hash bucket
+	uint64_t addr; // Address of the first instruction
+	uint64_t end; // Address following the last instruction
+	int count; // Number of instructions
+	struct block *links[BCACHE_NUM_LINKS]; // Blocks recently entered after this block
+	struct block *ret_link; // Block at end, entered by returning from a call ending this block
+	uint32_t hits; // Number of times the block was entered while not compiled
+	jit_entry_t native; // Compiled code for the block, or NULL
+	struct dinst insts[];
+};
+
+struct bcache {
+	struct block **buckets;
+	uint64_t block_count;
+	uint64_t code_gen; // Value of mem code_gen when the cached blocks were decoded
+	uint64_t fuse_counts[FUSE_COUNT]; // Number of times each fused sequence was executed
+	struct jit jit; // Compiled code for cached blocks
+	uint64_t flushes; // Number of times the cache was flushed
+	uint64_t jit_blocks; // Number of blocks compiled
+	uint64_t link_hits; // Number of blocks entered through successor links
+	uint64_t ret_hits, ret_misses; // Number of returns correctly and incorrectly predicted
+};
+
+void bcache_init(struct bcache*);
+void bcache_destroy(struct bcache*);
+
+// Removes all blocks from the cache, discarding their compiled code
+void bcache_flush(struct bcache*);
+
+// Returns the block beginning at the given address, decoding it from memory if
+// it is not already cached. handlers holds the handler for each opcode and
+// fused_handlers the handler for each fused sequence.
+// Returns NULL if no instruction can be decoded at the address, in which case
+// the instruction there should be executed with core_step.
+struct block *bcache_get(struct bcache*, struct mem*, uint64_t addr,
+	void *const handlers[256], void *const fused_handlers[FUSE_COUNT]);
@@ -30,3 +30,25 @@ struct bpmap *bpmap_remove(struct bpmap*, uint64_t addr);
 
 // Iterate through breakpoints, calling the given function for each
 int bpmap_iter(struct bpmap*, void *user_ptr, int (*iter_func)(uint64_t, int, void*));
+
+// Filter over the pages of breakpoint addresses giving an O(1) negative check.
+// Each bit covers every page whose number hashes to it. Rebuild the filter
+// whenever the BP map changes.
+enum {
+	BPFILTER_PAGE_SHIFT = 12, // Log2 of the page size covered by a bit
+	BPFILTER_BITS = 0x1000, // Must be a power of two
+};
+struct bpfilter {
+	uint64_t bits[BPFILTER_BITS / 64];
+};
+
+// Sets the given filter to cover exactly the pages of breakpoints in the map
+void bpfilter_build(struct bpfilter*, struct bpmap*);
+
+// Returns nonzero if the page containing addr may hold a breakpoint.
+// Returns zero if there is certainly no breakpoint at addr.
+static inline int bpfilter_test(const struct bpfilter *filter, uint64_t addr)
+{
+	uint64_t bit = (addr >> BPFILTER_PAGE_SHIFT) & (BPFILTER_BITS - 1);
+	return (filter->bits[bit / 64] >> (bit % 64)) & 1;
+}
@@ -4,21 +4,188 @@
 
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
+#include "bcache.h"
+#include "bpmap.h"
 #include "mem.h"
 
-struct core {
-	// The core Starch registers
-	uint64_t pc, sbp, sfp, sp, slp;
+enum { CORE_HOT_SIZE = 64 }; // Size and alignment of the hot state at the start of struct core
+
+enum { CORE_RAS_SIZE = 64 }; // Number of entries in the shadow return address stack. Must be a power of two.
+
+enum { STACK_FRAME_METADATA_SIZE = 16 }; // Size of the RETA and saved SFP skipped by negative SFP offsets
+
+enum { CORE_TLB_SIZE = 64 }; // Number of entries in each TLB. Must be a power of two.
+
+enum { CORE_MAILBOX_SIZE = 64 }; // Number of messages held by each mailbox. Must be a power of two.
+enum { CORE_MAX_FILES = 16 }; // Maximum number of host files open for the file device
+enum { CORE_STDOUT_SIZE = 0x10000 }; // Default size of the stdout buffer of each core
+
+// Translation of a guest page to the host data of the page
+struct core_tlb_entry {
+	uint64_t page; // Guest page address, or 1 if the entry is empty
+	uint8_t *data; // Host page data from mem_page_data
+};
+
+// Direct-mapped translation caches for core memory accesses
+struct core_tlb {
+	struct core_tlb_entry read[CORE_TLB_SIZE], write[CORE_TLB_SIZE];
+	uint64_t map_gen; // Value of mem->map_gen when the entries were filled
+	uint64_t hits, misses;
+};
+
+// Shadow return address stack entry
+struct core_ras_entry {
+	uint64_t reta; // Predicted return address
+	struct block *block; // Cached block ending with the call, whose end is reta
+	uint64_t flushes; // Block cache flush count when the entry was pushed
+};
+
+// Execution engines used by core_run
+enum {
+	CORE_ENGINE_SWITCH,   // Single-step with core_step()
+	CORE_ENGINE_THREADED, // Run batches of instructions with core_run_threaded()
+	CORE_ENGINE_BLOCK,    // Run batches of predecoded instructions with core_run_block()
+	CORE_ENGINE_JIT,      // As CORE_ENGINE_BLOCK, compiling hot blocks to native code
+};
 
-	// Buffers for stdin and stdout
+// Options selecting the core_run variant. Each combination is a separate run
+// loop, so options which are not set cost nothing per instruction.
+enum {
+	CORE_RUN_BREAKPOINTS = 1, // Stop after an instruction when pc is in bpmap
+	CORE_RUN_CYCLES = 2,      // Stop after *budget instructions
+	CORE_RUN_MENU = 4,        // Stop after every instruction
+};
+
+// Reasons core_run stopped
+enum {
+	CORE_STOP_BUDGET,     // *budget instructions were executed
+	CORE_STOP_HALT,       // The core halted
+	CORE_STOP_ERROR,      // An error occurred in the emulator
+	CORE_STOP_BREAKPOINT, // pc reached a breakpoint
+	CORE_STOP_STEP,       // A single instruction was executed for CORE_RUN_MENU
+};
+
+// When buffered stdout is written to the host
+enum {
+	CORE_STDOUT_LINE, // When a newline is written or the buffer fills
+	CORE_STDOUT_FULL, // When the buffer fills
+	CORE_STDOUT_NONE, // When each byte is written
+};
+
+// Buffered stdin and stdout state and file device registers, touched only by IO accesses
+struct core_io {
 	uint8_t *stdin_buff, *stdout_buff;
 	int stdin_head, stdin_tail, stdout_count;
+	int stdout_mode, stdout_size; // Buffering policy and buffer size of stdout
+	int file_select; // Index of the file transfers use
+	uint64_t file_addr, file_len, file_offset, file_result;
+};
+
+// Messages sent to a core by any core, which only the receiving core removes
+struct core_mailbox {
+	pthread_mutex_t lock; // Serializes senders
+	uint64_t msgs[CORE_MAILBOX_SIZE];
+	uint32_t head, tail; // Messages waiting are at [head, tail) modulo CORE_MAILBOX_SIZE
+	uint32_t seq; // Futex word incremented to wake the receiver
+};
+
+// Register values a waiting core starts with, written by another core
+struct core_start {
+	uint64_t pc, sbp, slp;
+	int ready; // Set once the other fields are written
+};
+
+// Cores sharing memory, which start each other through IO memory
+struct core_group {
+	struct core *cores;
+	int count;
+	int next_start; // Index of the next waiting core to start
+	int threaded; // Whether the cores run on their own threads, so that waits may block
+	int stopping; // Set by core_group_stop
+
+	// Host file descriptors of the files which cores transfer data to and from
+	// through IO memory, selected by index
+	int files[CORE_MAX_FILES];
+	int num_files;
+};
+
+struct core {
+	// Hot state used by every instruction, packed into the first cache line of
+	// the core so that cores in an array do not share lines. Add fields with care:
+	// coretest checks that the block fits in CORE_HOT_SIZE bytes.
+	struct {
+		// The core Starch registers
+		_Alignas(CORE_HOT_SIZE) uint64_t pc;
+		uint64_t sbp, sfp, sp, slp;
+
+		// Pinned stack region, starting at stack_addr with host address stack_host,
+		// or NULL if the region is not pinned. Valid while stack_gen equals mem->map_gen.
+		uint8_t *stack_host;
+		uint64_t stack_addr, stack_gen;
+	};
+
+	// End of the stack region [stack_addr, stack_end) last set by setsbp and
+	// setslp, which is pinned in memory while possible
+	uint64_t stack_end;
+
+	// Translations consulted by memory accesses before the memory tree
+	struct core_tlb tlb;
+
+	// Predecoded blocks for core_run_block
+	struct bcache bcache;
+
+	// Number of times core_run_block enters a block before compiling it to
+	// native code, or zero to disable compilation
+	uint32_t jit_threshold;
+
+	// Shadow return address stack pushed by calls and popped by returns in
+	// core_run_block. Predictions are validated against the RETA read by op_ret.
+	struct core_ras_entry ras[CORE_RAS_SIZE];
+	unsigned ras_top;
+
+	// Configuration of core_run
+	int engine; // CORE_ENGINE_*
+	int run_opts; // CORE_RUN_* flags
+	const struct bpmap *bpmap; // Breakpoints checked with CORE_RUN_BREAKPOINTS
+	const struct bpfilter *bpfilter; // Page filter for bpmap, checked first
+
+	// Number of instructions executed by core_run
+	uint64_t cycles;
+
+	// Index of the core and number of cores in the machine, read through IO memory
+	int id, num_cores;
+
+	// Cores of the machine, through which writes to IO_CORE_START_ADDR start
+	// waiting cores, or NULL
+	struct core_group *group;
+
+	// Whether the core waits to be started by another core, and the state it
+	// starts with once start.ready is set
+	int waiting;
+	struct core_start start;
+
+	// Messages sent to the core, the core its own sends go to, and whether its
+	// last send was delivered
+	struct core_mailbox mailbox;
+	int mailbox_target, mailbox_sent;
+
+	// Cold IO buffering state
+	struct core_io io;
 };
 
 void core_init(struct core*);
 void core_destroy(struct core*);
 
+// Sets the buffering policy of stdout to one of CORE_STDOUT_* with a buffer of
+// the given number of bytes, which is ignored for CORE_STDOUT_NONE. Cores start
+// with CORE_STDOUT_LINE and a buffer of CORE_STDOUT_SIZE bytes. Returns 0 on success.
+int core_set_stdout(struct core*, int mode, int size);
+
+// Writes bytes buffered by guest writes to stdout to the host. Returns 0 on success.
+int core_flush_stdout(struct core*);
+
 // Executes a single instruction on the core based on the given memory.
 // A negative return value indicates an error in the emulator.
 // A return value of zero indicates the instruction completed without interrupt.
@@ -26,3 +193,34 @@ void core_destroy(struct core*);
 // A return value greater than or equal to 256 indicates the core should halt.
 // The halt code is 256 less than the return value.
 int core_step(struct core*, struct mem*);
+
+// Executes up to *budget instructions on the core using direct-threaded dispatch.
+// Interrupts are vectored and execution continues as with repeated core_step calls.
+// Stops early when the core halts or an emulator error occurs, or, if stop is not
+// NULL, before executing an instruction on a page flagged in stop. On return *budget
+// holds the number of instructions not executed. Returns the value core_step would
+// have returned for the last instruction executed.
+int core_run_threaded(struct core*, struct mem*, uint64_t *budget, const struct bpfilter *stop);
+
+// Executes up to *budget instructions on the core from predecoded blocks, with the
+// same semantics as core_run_threaded. Blocks are cached on the core and flushed
+// when memory they were decoded from is modified. Frequently entered blocks are
+// compiled to native code if jit_threshold is set and the host is supported.
+// With stop, blocks with instructions on flagged pages are not entered.
+int core_run_block(struct core*, struct mem*, uint64_t *budget, const struct bpfilter *stop);
+
+// Executes instructions on the core with the engine and options configured on the
+// core until a stop condition is reached, and sets *stop_reason to a CORE_STOP_*
+// value. Interrupts are vectored and execution continues. Without CORE_RUN_CYCLES
+// the core runs until it halts, hits a breakpoint, or fails, and *budget is not
+// used. Otherwise on return *budget holds the number of instructions not executed.
+// Returns the value core_step would have returned for the last instruction executed.
+int core_run(struct core*, struct mem*, uint64_t *budget, int *stop_reason);
+
+// Starts the core if it is waiting and another core has written its start state.
+// Returns nonzero if the core is still waiting.
+int core_wait_start(struct core*, struct mem*);
+
+// Asks cores in the group to stop, waking any blocked in a mailbox wait. Cores
+// running on their own threads check group->stopping between slices.
+void core_group_stop(struct core_group*);
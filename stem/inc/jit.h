@@ -0,0 +1,53 @@
+// jit.h
+//
+// Compiler from predecoded Starch blocks to native code
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mem.h"
+
+struct block;
+struct core;
+struct dinst;
+
+// Executes a single decoded instruction with the given immediate argument.
+// Returns the same values as core_step, without vectoring interrupts.
+typedef int (*jit_helper_t)(struct core*, struct mem*, uint64_t imm);
+
+// Executes the fused sequence beginning with the given decoded instruction.
+// Adds the number of instructions executed to *executed, including one which
+// returned nonzero, stopping early if code in memory is modified.
+// Returns the value returned by the last instruction executed.
+typedef int (*jit_fused_helper_t)(struct core*, struct mem*, const struct dinst*, uint64_t *executed);
+
+// Entry point of a compiled block. Executes the instructions of the block in
+// order until one returns nonzero or modifies code in memory. Sets *executed to
+// the number of instructions executed, including one which returned nonzero.
+// Returns the value returned by the last instruction executed.
+typedef int (*jit_entry_t)(struct core*, struct mem*, uint64_t *executed);
+
+enum {
+	JIT_ARENA_SIZE = 0x1000000, // Size of the executable code arena
+	JIT_DEFAULT_THRESHOLD = 16, // Number of block executions before compilation
+};
+
+struct jit {
+	uint8_t *arena; // Executable code arena, mapped on first compilation
+	size_t used; // Number of bytes used in the arena
+	uint8_t *exit, *reload; // Routines shared by compiled blocks, at the start of the arena
+};
+
+void jit_init(struct jit*);
+void jit_destroy(struct jit*);
+
+// Discards all compiled code
+void jit_flush(struct jit*);
+
+// Compiles the given block, which was decoded when mem code_gen was code_gen.
+// helpers holds the helper for each opcode and fused_helpers the helper for
+// each fused sequence.
+// Returns NULL if the host is unsupported or the arena is full.
+jit_entry_t jit_compile(struct jit*, const struct block*, uint64_t code_gen,
+	jit_helper_t const helpers[256], jit_fused_helper_t const fused_helpers[]);
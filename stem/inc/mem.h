@@ -5,18 +5,97 @@
 #pragma once
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 
+enum {
+	MEM_PAGE_SIZE = 0x1000,
+	MEM_PAGE_MASK = (MEM_PAGE_SIZE - 1),
+};
+
+// Structures indexing the pages of a mem object
+enum {
+	MEM_BACKEND_TREE,  // Self-balancing binary tree of pages
+	MEM_BACKEND_RADIX, // Radix table over page numbers, with depth set by the memory size
+	MEM_BACKEND_FLAT,  // Single host mapping reserved for the whole memory size
+};
+
+// Page flags for MEM_BACKEND_FLAT
+enum {
+	MEM_FLAT_WRITTEN = 1, // The page has been written
+	MEM_FLAT_CODE = 2,    // The page holds decoded code
+};
+
+enum {
+	MEM_RADIX_BITS = 9, // Page number bits indexing each level of the radix table
+	MEM_RADIX_FANOUT = 1 << MEM_RADIX_BITS,
+};
+
+enum {
+	MEM_MAX_PINS = 16, // Maximum number of pinned regions
+	MEM_PIN_MAX_SIZE = 0x1000000, // Maximum size of a pinned region
+};
+
+// A page-aligned region of memory held in one contiguous host buffer instead
+// of the page index
+struct mem_pin {
+	uint64_t addr, end; // Guest address range
+	uint8_t *data; // Host buffer holding the region
+	uint8_t *code; // Whether each page of the region holds decoded code
+};
+
 struct mem_node;
 
 struct mem {
-	struct mem_node *root;
+	int backend; // MEM_BACKEND_*
+	struct mem_node *root; // Tree root for MEM_BACKEND_TREE
+	void **radix; // Top-level table for MEM_BACKEND_RADIX
+	int radix_levels; // Number of levels of tables for MEM_BACKEND_RADIX
+	uint8_t *flat; // Host address of guest address zero for MEM_BACKEND_FLAT
+	uint8_t *flat_pages; // MEM_FLAT_* flags of each page for MEM_BACKEND_FLAT
 	uint64_t node_count, size;
+	// Generation counters, accessed atomically through mem_code_gen and mem_map_gen
+	// while other threads may modify them
+	uint64_t code_gen; // Incremented when a page marked as code is modified
+	uint64_t map_gen; // Incremented when pointers from mem_page_data become invalid
+	int zero_mapped; // Whether mem_page_data has returned the zero page since map_gen changed
+	struct mem_pin pins[MEM_MAX_PINS]; // Pinned regions in address order
+	int pin_count;
+	uint8_t **retired; // Buffers of regions unpinned while shared, freed by mem_destroy
+	int retired_count;
+	int shared; // Whether the memory is accessed from multiple threads
+	pthread_mutex_t lock; // Serializes page index accesses when shared
 };
 
-// Initializes the given mem struct with the given size.
-// Addresses must be less than size.
-void mem_init(struct mem*, uint64_t size);
+// Return the generation counters of the memory. Relaxed loads keep the checks
+// made before every access cheap, while still seeing changes by other threads.
+static inline uint64_t mem_code_gen(const struct mem *mem)
+{
+	return __atomic_load_n(&mem->code_gen, __ATOMIC_RELAXED);
+}
+static inline uint64_t mem_map_gen(const struct mem *mem)
+{
+	return __atomic_load_n(&mem->map_gen, __ATOMIC_RELAXED);
+}
+
+// Returns the MEM_FLAT_* flags of the given page number of flat memory, which
+// other threads may set while holding the lock. Marking a page as code sets its
+// flags before incrementing map_gen.
+static inline uint8_t mem_flat_flags(const struct mem *mem, uint64_t page)
+{
+	return __atomic_load_n(mem->flat_pages + page, __ATOMIC_ACQUIRE);
+}
+
+// Initializes the given mem struct with the given size and MEM_BACKEND_* backend.
+// Addresses must be less than size. Returns 0 on success.
+int mem_init(struct mem*, uint64_t size, int backend);
+
+// Makes the memory safe to access from multiple threads. Accesses to the page
+// index are serialized. So that pointers from mem_page_data stay valid while other
+// threads use them, mem_pin no longer moves pages out of the index, and only pins
+// ranges with no page yet written, and mem_unpin keeps the buffer until
+// mem_destroy. Returns 0 on success.
+int mem_share(struct mem*);
 
 // Destroys the given mem struct, deallocating all its memory
 void mem_destroy(struct mem*);
@@ -33,6 +112,35 @@ int mem_read16(struct mem*, uint64_t addr, uint16_t *data);
 int mem_read32(struct mem*, uint64_t addr, uint32_t *data);
 int mem_read64(struct mem*, uint64_t addr, uint64_t *data);
 
+// Marks the page containing the given address as holding decoded code.
+// The next modification of the page increments code_gen and clears the mark.
+// The code should be read after marking, so that writes by other threads are
+// either read or counted. Returns 0 on success.
+int mem_mark_code(struct mem*, uint64_t addr);
+
+// Returns a pointer to the data of the page containing the given address, for
+// direct access to the whole page. Returns NULL if the page extends past the
+// memory size. If write is nonzero the page is allocated if needed and noted as
+// modified. Otherwise the pointer may be to a shared zero page and must not be
+// written through. The pointer remains valid until map_gen changes.
+uint8_t *mem_page_data(struct mem*, uint64_t addr, int write);
+
+// Holds the pages covering the given range in one contiguous host buffer, so that
+// the range may be accessed directly. Loads and stores through the other memory
+// functions use the same buffer. Returns a pointer to the host data for addr, or
+// NULL if the range cannot be pinned because it is too large, overlaps another
+// pinned range, or holds code. Pinning the range of an existing pinned region
+// returns the existing buffer. The pointer remains valid until map_gen changes.
+uint8_t *mem_pin(struct mem*, uint64_t addr, uint64_t size);
+
+// Returns the pages of the pinned region containing addr to the page index.
+// Does nothing if addr is not pinned.
+void mem_unpin(struct mem*, uint64_t addr);
+
+// Frees pages whose data is all zero and which are not marked as code. Reads of
+// such pages return zero as for pages never written. Returns the number of pages freed.
+uint64_t mem_reclaim(struct mem*);
+
 // Load a binary image file into memory. Returns 0 on success.
 int mem_load_image(struct mem*, uint64_t addr, uint64_t size, FILE *image_file);
 
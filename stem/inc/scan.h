@@ -0,0 +1,28 @@
+// scan.h
+//
+// Vectorized scans of host byte buffers, used by the string and search
+// extended operations
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Instruction set levels of the scan kernels
+enum {
+	SCAN_SCALAR, // Portable byte loop
+	SCAN_SSE2,
+	SCAN_AVX2,
+	SCAN_NUM_LEVELS,
+};
+
+// Selects the kernels of the given level. Returns 0 on success, or nonzero if
+// the host does not support the level. The best supported level is selected
+// by default.
+int scan_select(int level);
+
+// Returns the index of the first byte of data equal to c, or len if there is none
+size_t scan_byte(const uint8_t *data, size_t len, uint8_t c);
+
+// Returns the index of the first byte at which a and b differ, or len if they are equal
+size_t scan_diff(const uint8_t *a, const uint8_t *b, size_t len);
@@ -7,12 +7,15 @@
 #include "core.h"
 #include "mem.h"
 
-// The number of cores in the Starch virtual machine
-enum { STEM_NUM_CORES = 1 }; // Currently single-core
+// The maximum number of cores in the Starch virtual machine
+enum { STEM_MAX_CORES = 64 };
+
+// The number of cores in use, set by --cores
+extern int stem_num_cores;
 
 // Array of Starch virtual machine cores.
 // The first element of the array is the main core.
-extern struct core cores[STEM_NUM_CORES];
+extern struct core cores[STEM_MAX_CORES];
 
 // The main emulated memory
 extern struct mem main_mem;
@@ -20,6 +23,9 @@ extern struct mem main_mem;
 // Breakpoint map
 extern struct bpmap *bpmap;
 
+// Page filter for the breakpoint map. Rebuilt whenever the map changes.
+extern struct bpfilter bpfilter;
+
 enum { // stem flags
 	SF_RUN = 1,  // Whether to run (else pause and enter debug menu)
 	SF_EXIT = 2, // Whether to exit
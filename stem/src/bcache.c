@@ -0,0 +1,280 @@
+// bcache.c
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bcache.h"
+#include "starch.h"
+#include "util.h"
+
+static const char *fuse_names[FUSE_COUNT] = {
+	[FUSE_PUSHI_LOADPOPSFP8] = "pushi64+loadpopsfp8",
+	[FUSE_PUSHI_LOADPOPSFP16] = "pushi64+loadpopsfp16",
+	[FUSE_PUSHI_LOADPOPSFP32] = "pushi64+loadpopsfp32",
+	[FUSE_PUSHI_LOADPOPSFP64] = "pushi64+loadpopsfp64",
+	[FUSE_PUSHI_ADD64] = "pushi64+add64",
+	[FUSE_PUSHI_SUB64] = "pushi64+sub64",
+	[FUSE_CMP_BRZ64] = "cmp64+rbrz64",
+	[FUSE_DUP_PUSHI_CMP_BRZ64] = "dup64+pushi64+cmp64+rbrz64",
+	[FUSE_DUP_PUSHSFP_CMP_BRZ64] = "dup64+pushi64+loadpopsfp64+cmp64+rbrz64",
+};
+
+static const int fuse_lens[FUSE_COUNT] = {
+	[FUSE_PUSHI_LOADPOPSFP8] = 2,
+	[FUSE_PUSHI_LOADPOPSFP16] = 2,
+	[FUSE_PUSHI_LOADPOPSFP32] = 2,
+	[FUSE_PUSHI_LOADPOPSFP64] = 2,
+	[FUSE_PUSHI_ADD64] = 2,
+	[FUSE_PUSHI_SUB64] = 2,
+	[FUSE_CMP_BRZ64] = 2,
+	[FUSE_DUP_PUSHI_CMP_BRZ64] = 4,
+	[FUSE_DUP_PUSHSFP_CMP_BRZ64] = 5,
+};
+
+const char *name_for_fuse(int fuse)
+{
+	if (fuse <= FUSE_NONE || fuse >= FUSE_COUNT) return NULL;
+	return fuse_names[fuse];
+}
+
+int fuse_len(int fuse)
+{
+	if (fuse <= FUSE_NONE || fuse >= FUSE_COUNT) return 0;
+	return fuse_lens[fuse];
+}
+
+void bcache_init(struct bcache *bc)
+{
+	memset(bc, 0, sizeof(struct bcache));
+	jit_init(&bc->jit);
+}
+
+void bcache_destroy(struct bcache *bc)
+{
+	bcache_flush(bc);
+	free(bc->buckets);
+	bc->buckets = NULL;
+	jit_destroy(&bc->jit);
+}
+
+void bcache_flush(struct bcache *bc)
+{
+	if (bc->buckets == NULL) return;
+	for (int i = 0; i < BCACHE_NUM_BUCKETS; i++) {
+		struct block *block = bc->buckets[i];
+		while (block) {
+			struct block *next = block->next;
+			free(block);
+			block = next;
+		}
+		bc->buckets[i] = NULL;
+	}
+	bc->block_count = 0;
+	bc->flushes++;
+	jit_flush(&bc->jit);
+}
+
+static unsigned bcache_hash(uint64_t addr)
+{
+	return (addr ^ (addr >> 12)) & (BCACHE_NUM_BUCKETS - 1);
+}
+
+// Returns whether the given opcode ends a block
+static int bcache_ends_block(int opcode)
+{
+	int jmp_br, delta;
+	opcode_is_jmp_br(opcode, &jmp_br, &delta);
+	if (jmp_br) return 1;
+
+	switch (opcode) {
+	case op_invalid:
+	case op_call:
+	case op_calls:
+	case op_ret:
+	case op_jmps:
+	case op_halt:
+		return 1;
+	}
+	return 0;
+}
+
+// Decodes the instruction at the given address. Returns 0 on success.
+static int bcache_decode(struct mem *mem, uint64_t addr, struct dinst *di, void *const handlers[256])
+{
+	// Don't decode from IO memory, where reads have side effects
+	if (addr < END_IO_ADDR) return 1;
+
+	uint8_t opcode;
+	int ret = mem_read8(mem, addr, &opcode);
+	if (ret) return ret;
+
+	int imm_type = imm_type_for_opcode(opcode);
+	if (imm_type < 0) return 1;
+	int imm_size = sdt_size(imm_type);
+
+	// Don't decode instructions which cross a page boundary
+	if (((addr + imm_size) & ~(uint64_t)MEM_PAGE_MASK) != (addr & ~(uint64_t)MEM_PAGE_MASK)) {
+		return 1;
+	}
+
+	uint8_t buf[8];
+	ret = mem_read(mem, addr + 1, imm_size, buf);
+	if (ret) return ret;
+	switch (imm_type) {
+	case SDT_VOID: di->imm = 0; break;
+	case SDT_I8: di->imm = (int8_t)buf[0]; break;
+	case SDT_I16: di->imm = (int16_t)get_little16(buf); break;
+	case SDT_I32: di->imm = (int32_t)get_little32(buf); break;
+	default:
+		switch (imm_size) {
+		case 1: di->imm = buf[0]; break;
+		case 2: di->imm = get_little16(buf); break;
+		case 4: di->imm = get_little32(buf); break;
+		case 8: di->imm = get_little64(buf); break;
+		}
+	}
+	di->handler = handlers[opcode];
+	di->opcode = opcode;
+	di->len = 1 + imm_size;
+	di->fuse = FUSE_NONE;
+	return 0;
+}
+
+// Returns whether the given opcode pushes its immediate argument as a 64 bit value
+static int is_pushi64(int opcode)
+{
+	switch (opcode) {
+	case op_push8asu64:
+	case op_push8asi64:
+	case op_push16asu64:
+	case op_push16asi64:
+	case op_push32asu64:
+	case op_push32asi64:
+	case op_push64as64:
+		return 1;
+	}
+	return 0;
+}
+
+// Returns whether the given opcode is a 64 bit comparison
+static int is_cmp64(int opcode)
+{
+	switch (opcode) {
+	case op_ceq64:
+	case op_cne64:
+	case op_cgtu64:
+	case op_cgti64:
+	case op_cltu64:
+	case op_clti64:
+	case op_cgeu64:
+	case op_cgei64:
+	case op_cleu64:
+	case op_clei64:
+		return 1;
+	}
+	return 0;
+}
+
+// Returns whether the given opcode is a 64 bit relative branch
+static int is_rbrz64(int opcode)
+{
+	return opcode == op_rbrz64i8 || opcode == op_rbrz64i16 || opcode == op_rbrz64i32;
+}
+
+// Returns the fused sequence beginning at the first of the given count instructions,
+// or FUSE_NONE if there is none
+static int bcache_match_fuse(const struct dinst *di, int count)
+{
+	if (count >= 5 && di[0].opcode == op_dup64 && is_pushi64(di[1].opcode) &&
+		di[2].opcode == op_loadpopsfp64 && is_cmp64(di[3].opcode) && is_rbrz64(di[4].opcode)) {
+		return FUSE_DUP_PUSHSFP_CMP_BRZ64;
+	}
+	if (count >= 4 && di[0].opcode == op_dup64 && is_pushi64(di[1].opcode) &&
+		is_cmp64(di[2].opcode) && is_rbrz64(di[3].opcode)) {
+		return FUSE_DUP_PUSHI_CMP_BRZ64;
+	}
+	if (count >= 2 && is_pushi64(di[0].opcode)) {
+		switch (di[1].opcode) {
+		case op_loadpopsfp8: return FUSE_PUSHI_LOADPOPSFP8;
+		case op_loadpopsfp16: return FUSE_PUSHI_LOADPOPSFP16;
+		case op_loadpopsfp32: return FUSE_PUSHI_LOADPOPSFP32;
+		case op_loadpopsfp64: return FUSE_PUSHI_LOADPOPSFP64;
+		case op_add64: return FUSE_PUSHI_ADD64;
+		case op_sub64: return FUSE_PUSHI_SUB64;
+		}
+	}
+	if (count >= 2 && is_cmp64(di[0].opcode) && is_rbrz64(di[1].opcode)) {
+		return FUSE_CMP_BRZ64;
+	}
+	return FUSE_NONE;
+}
+
+struct block *bcache_get(struct bcache *bc, struct mem *mem, uint64_t addr,
+	void *const handlers[256], void *const fused_handlers[FUSE_COUNT])
+{
+	uint64_t code_gen = mem_code_gen(mem);
+	if (bc->code_gen != code_gen) {
+		// Code in memory was modified since blocks were decoded
+		bcache_flush(bc);
+		bc->code_gen = code_gen;
+	}
+	if (bc->buckets == NULL) {
+		bc->buckets = (struct block**)calloc(BCACHE_NUM_BUCKETS, sizeof(struct block*));
+	}
+
+	// Look for a cached block
+	unsigned hash = bcache_hash(addr);
+	struct block *block;
+	for (block = bc->buckets[hash]; block; block = block->next) {
+		if (block->addr == addr) return block;
+	}
+
+	// Decode a new block
+	struct dinst insts[BCACHE_MAX_INSTS];
+	int count = 0;
+	uint64_t inst_addr = addr, marked_end = 0;
+	while (count < BCACHE_MAX_INSTS) {
+		// Mark each page before reading instructions from it, so that a write by
+		// another core which the decoder misses increments code_gen
+		uint64_t page = inst_addr & ~(uint64_t)MEM_PAGE_MASK;
+		if (page >= marked_end) {
+			if (inst_addr < END_IO_ADDR || mem_mark_code(mem, page)) break;
+			marked_end = page + MEM_PAGE_SIZE;
+		}
+		if (bcache_decode(mem, inst_addr, insts + count, handlers)) break;
+		inst_addr += insts[count].len;
+		if (bcache_ends_block(insts[count++].opcode)) break;
+	}
+	if (count == 0) return NULL;
+	if (mem_code_gen(mem) != code_gen) {
+		// The code was modified while decoding, so the instructions may be stale
+		return NULL;
+	}
+
+	// Install fused handlers. The following instructions keep their own handlers
+	// so engines can fall back to them.
+	for (int i = 0; i < count; i++) {
+		int fuse = bcache_match_fuse(insts + i, count - i);
+		if (fuse != FUSE_NONE) {
+			insts[i].handler = fused_handlers[fuse];
+			insts[i].fuse = fuse;
+		}
+	}
+
+	if (bc->block_count >= BCACHE_MAX_BLOCKS) {
+		bcache_flush(bc);
+	}
+	block = (struct block*)malloc(sizeof(struct block) + count * sizeof(struct dinst));
+	block->addr = addr;
+	block->end = inst_addr;
+	block->count = count;
+	memset(block->links, 0, sizeof(block->links));
+	block->ret_link = NULL;
+	block->hits = 0;
+	block->native = NULL;
+	memcpy(block->insts, insts, count * sizeof(struct dinst));
+	block->next = bc->buckets[hash];
+	bc->buckets[hash] = block;
+	bc->block_count++;
+	return block;
+}
@@ -24,3 +24,18 @@ static int comp_addr(uint64_t left, uint64_t right)
 #undef COMPF
 #undef KEYDELF
 #undef VALDELF
+
+static int bpfilter_set(uint64_t addr, int count, void *user_ptr)
+{
+	(void)count;
+	struct bpfilter *filter = (struct bpfilter*)user_ptr;
+	uint64_t bit = (addr >> BPFILTER_PAGE_SHIFT) & (BPFILTER_BITS - 1);
+	filter->bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+	return 0;
+}
+
+void bpfilter_build(struct bpfilter *filter, struct bpmap *map)
+{
+	memset(filter, 0, sizeof(struct bpfilter));
+	bpmap_iter(map, filter, bpfilter_set);
+}
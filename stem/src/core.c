@@ -1,53 +1,157 @@
 // core.c
 
 #include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "core.h"
+#include "scan.h"
 #include "starch.h"
+#include "util.h"
 
 // Constants
 enum {
-	STDINOUT_BUFF_SIZE = 0x400,
-	STACK_FRAME_METADATA_SIZE = 16,
+	STDIN_BUFF_SIZE = 0x10000,
 };
 
+// Empties the TLBs of the given core
+static void core_tlb_flush(struct core *core)
+{
+	for (int i = 0; i < CORE_TLB_SIZE; i++) {
+		core->tlb.read[i].page = 1;
+		core->tlb.write[i].page = 1;
+	}
+}
+
 void core_init(struct core *core)
 {
 	memset(core, 0, sizeof(struct core));
 	core->pc = INIT_PC_VAL;
-	core->stdin_buff = (uint8_t*)malloc(STDINOUT_BUFF_SIZE);
-	core->stdout_buff = (uint8_t*)malloc(STDINOUT_BUFF_SIZE);
+	core->io.stdin_buff = (uint8_t*)malloc(STDIN_BUFF_SIZE);
+	core->io.stdout_buff = (uint8_t*)malloc(CORE_STDOUT_SIZE);
+	core->io.stdout_mode = CORE_STDOUT_LINE;
+	core->io.stdout_size = CORE_STDOUT_SIZE;
+	core_tlb_flush(core);
+	bcache_init(&core->bcache);
+	pthread_mutex_init(&core->mailbox.lock, NULL);
 }
 
 void core_destroy(struct core *core)
 {
-	free(core->stdout_buff);
-	core->stdout_buff = NULL;
-	free(core->stdin_buff);
-	core->stdin_buff = NULL;
+	// Output is kept when the core stops without halting
+	core_flush_stdout(core);
+	free(core->io.stdout_buff);
+	core->io.stdout_buff = NULL;
+	free(core->io.stdin_buff);
+	core->io.stdin_buff = NULL;
+	bcache_destroy(&core->bcache);
+	pthread_mutex_destroy(&core->mailbox.lock);
+}
+
+// Wakes up to count threads blocked in core_mailbox_wait on the mailbox
+static void core_mailbox_wake(struct core_mailbox *mb, int count)
+{
+	__atomic_fetch_add(&mb->seq, 1, __ATOMIC_RELEASE);
+	syscall(SYS_futex, &mb->seq, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Returns the number of messages waiting in the core's mailbox
+static uint8_t core_mailbox_count(struct core *core)
+{
+	struct core_mailbox *mb = &core->mailbox;
+	return __atomic_load_n(&mb->tail, __ATOMIC_ACQUIRE) - mb->head;
+}
+
+// Returns the number of messages waiting in the core's mailbox, first blocking
+// the thread until there is one if the cores run on their own threads. Also
+// returns when the group is asked to stop.
+static uint8_t core_mailbox_wait(struct core *core)
+{
+	struct core_mailbox *mb = &core->mailbox;
+	for (;;) {
+		uint32_t seq = __atomic_load_n(&mb->seq, __ATOMIC_ACQUIRE);
+		uint8_t count = core_mailbox_count(core);
+		if (count || !core->group || !__atomic_load_n(&core->group->threaded, __ATOMIC_RELAXED) ||
+			__atomic_load_n(&core->group->stopping, __ATOMIC_RELAXED)) {
+			return count;
+		}
+		// Sleeps unless a message was sent since seq was read
+		syscall(SYS_futex, &mb->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL, 0);
+	}
+}
+
+// Removes and returns the oldest message in the core's mailbox, or 0 if empty
+static uint64_t core_mailbox_recv(struct core *core)
+{
+	struct core_mailbox *mb = &core->mailbox;
+	if (__atomic_load_n(&mb->tail, __ATOMIC_ACQUIRE) == mb->head) {
+		return 0;
+	}
+	uint64_t msg = mb->msgs[mb->head % CORE_MAILBOX_SIZE];
+	// Releases the slot to senders
+	__atomic_store_n(&mb->head, mb->head + 1, __ATOMIC_RELEASE);
+	return msg;
+}
+
+// Sends the message to the mailbox of the core's target, setting mailbox_sent
+// to whether there was room for it
+static void core_mailbox_send(struct core *core, uint64_t msg)
+{
+	struct core *target = core;
+	if (core->group) {
+		target = core->group->cores + core->mailbox_target;
+	}
+	struct core_mailbox *mb = &target->mailbox;
+	pthread_mutex_lock(&mb->lock);
+	core->mailbox_sent = mb->tail - __atomic_load_n(&mb->head, __ATOMIC_ACQUIRE) < CORE_MAILBOX_SIZE;
+	if (core->mailbox_sent) {
+		mb->msgs[mb->tail % CORE_MAILBOX_SIZE] = msg;
+		__atomic_store_n(&mb->tail, mb->tail + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&mb->lock);
+	if (core->mailbox_sent) {
+		core_mailbox_wake(mb, 1);
+	}
+}
+
+void core_group_stop(struct core_group *group)
+{
+	__atomic_store_n(&group->stopping, 1, __ATOMIC_RELAXED);
+	for (int i = 0; i < group->count; i++) {
+		core_mailbox_wake(&group->cores[i].mailbox, INT_MAX);
+	}
+}
+
+// Initializes the random number generator with entropy, setting
+// core_random_ret nonzero on failure
+static int core_random_ret;
+static void core_random_init(void)
+{
+	// The generator keeps using the buffer as its state, so it must outlive this call
+	enum { ENTROPY_SIZE = 128 };
+	static char entropy[ENTROPY_SIZE];
+	core_random_ret = getentropy(entropy, ENTROPY_SIZE);
+	if (core_random_ret == 0) {
+		initstate(0, entropy, ENTROPY_SIZE);
+	}
 }
 
 // Read buflen random bytes into the buffer at buf.
 // Returns zero on success, negative on failure.
 static int core_get_random(void *buf, size_t buflen)
 {
-	int ret;
-
-	static int inited;
-	if (!inited) {
-		// Initialize the random number generator with entropy
-		enum { ENTROPY_SIZE = 128 };
-		char entropy[ENTROPY_SIZE];
-		ret = getentropy(entropy, ENTROPY_SIZE);
-		if (ret != 0) {
-			return ret;
-		}
-		initstate(0, entropy, ENTROPY_SIZE);
-		inited = 1;
+	// Cores on other threads may read random data at the same time
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, core_random_init);
+	if (core_random_ret != 0) {
+		return core_random_ret;
 	}
 
 	size_t i = 0;
@@ -71,46 +175,306 @@ static int core_get_random(void *buf, size_t buflen)
 static int core_read_stdin(struct core *core, uint8_t *b)
 {
 	int ret = 0;
-	if (core->stdin_head != core->stdin_tail) {
+	if (core->io.stdin_head != core->io.stdin_tail) {
 		// There is already buffered data available
-		*b = core->stdin_buff[core->stdin_head++];
+		*b = core->io.stdin_buff[core->io.stdin_head++];
 	}
 	else {
 		// Read available up to buffer size
-		core->stdin_head = 0;
-		ssize_t bc = read(0, core->stdin_buff, STDINOUT_BUFF_SIZE);
+		core->io.stdin_head = 0;
+		ssize_t bc = read(0, core->io.stdin_buff, STDIN_BUFF_SIZE);
 		if (bc > 0) {
-			core->stdin_tail = bc;
+			core->io.stdin_tail = bc;
+			*b = core->io.stdin_buff[core->io.stdin_head++];
 		}
 		else {
-			core->stdin_tail = 0;
+			core->io.stdin_tail = 0;
 			ret = errno ? errno : 1;
 		}
 	}
 	return ret;
 }
 
-static int core_flush_stdout(struct core *core)
+int core_set_stdout(struct core *core, int mode, int size)
+{
+	if (mode == CORE_STDOUT_NONE) size = 1;
+	if (size < 1) return EINVAL;
+	int ret = core_flush_stdout(core);
+	if (ret) return ret;
+	uint8_t *buff = (uint8_t*)realloc(core->io.stdout_buff, size);
+	if (buff == NULL) return ENOMEM;
+	core->io.stdout_buff = buff;
+	core->io.stdout_mode = mode;
+	core->io.stdout_size = size;
+	return 0;
+}
+
+int core_flush_stdout(struct core *core)
 {
-	// Flush to stdout
+	// Flush to stdout, which may take several writes for large buffers
 	int ret = 0;
-	ssize_t bc = write(1, core->stdout_buff, core->stdout_count);
-	if (bc != core->stdout_count) ret = errno;
-	core->stdout_count = 0;
+	for (int done = 0; done < core->io.stdout_count;) {
+		ssize_t bc = write(1, core->io.stdout_buff + done, core->io.stdout_count - done);
+		if (bc <= 0) {
+			ret = errno ? errno : EIO;
+			break;
+		}
+		done += bc;
+	}
+	core->io.stdout_count = 0;
 	return ret;
 }
 
 static int core_write_stdout(struct core *core, uint8_t b)
 {
 	int ret = 0;
-	core->stdout_buff[core->stdout_count++] = b;
-	if (core->stdout_count >= STDINOUT_BUFF_SIZE || b == '\n') {
-		// Flush when buffer fills or newline is written
+	core->io.stdout_buff[core->io.stdout_count++] = b;
+	if (core->io.stdout_count >= core->io.stdout_size ||
+		(b == '\n' && core->io.stdout_mode == CORE_STDOUT_LINE)) {
+		// Flush when buffer fills or newline is written with line buffering
 		ret = core_flush_stdout(core);
 	}
 	return ret;
 }
 
+// Returns a host pointer for an access of size bytes at the given address, or
+// NULL if the access must go through the memory object. Flat memory is addressed
+// directly, except for writes to pages not yet written or holding code. Otherwise
+// accesses which cross a page boundary are never translated.
+static inline uint8_t *core_tlb_translate(struct core *core, struct mem *mem, uint64_t addr,
+	uint64_t size, int write)
+{
+	if (mem->flat) {
+		if (addr > mem->size - size) {
+			return NULL;
+		}
+		if (write) {
+			if (mem->shared) {
+				// Read before the flags for core_tlb_written
+				core->tlb.map_gen = __atomic_load_n(&mem->map_gen, __ATOMIC_ACQUIRE);
+			}
+			if (mem_flat_flags(mem, addr / MEM_PAGE_SIZE) != MEM_FLAT_WRITTEN ||
+				mem_flat_flags(mem, (addr + size - 1) / MEM_PAGE_SIZE) != MEM_FLAT_WRITTEN) {
+				return NULL;
+			}
+		}
+		return mem->flat + addr;
+	}
+	if ((addr & MEM_PAGE_MASK) > MEM_PAGE_SIZE - size) {
+		return NULL;
+	}
+	uint64_t map_gen = mem_map_gen(mem);
+	if (core->tlb.map_gen != map_gen) {
+		core_tlb_flush(core);
+		core->tlb.map_gen = map_gen;
+	}
+
+	uint64_t page = addr & ~(uint64_t)MEM_PAGE_MASK;
+	struct core_tlb_entry *entry = (write ? core->tlb.write : core->tlb.read) +
+		((addr / MEM_PAGE_SIZE) & (CORE_TLB_SIZE - 1));
+	if (entry->page != page) {
+		core->tlb.misses++;
+		uint8_t *data = mem_page_data(mem, addr, write);
+		if (!data) return NULL;
+		entry->page = page;
+		entry->data = data;
+	}
+	else {
+		core->tlb.hits++;
+	}
+	return entry->data + (addr & MEM_PAGE_MASK);
+}
+
+// Completes a write of size bytes at addr through a host pointer obtained while
+// map_gen had the given value. In shared memory another core may have marked a
+// page as code since, and decoded it before the write, in which case the write is
+// noted so that code_gen is incremented.
+static inline void core_note_written(struct mem *mem, uint64_t addr, uint64_t size,
+	uint64_t map_gen)
+{
+	if (!mem->shared) {
+		return;
+	}
+	// Pairs with the fence after marking in mem_mark_code
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (mem_map_gen(mem) != map_gen) {
+		mem_page_data(mem, addr, 1);
+		if ((addr ^ (addr + size - 1)) & ~(uint64_t)MEM_PAGE_MASK) {
+			mem_page_data(mem, addr + size - 1, 1);
+		}
+	}
+}
+
+// Completes a write of size bytes at addr through a pointer from core_tlb_translate
+static inline void core_tlb_written(struct core *core, struct mem *mem, uint64_t addr,
+	uint64_t size)
+{
+	core_note_written(mem, addr, size, core->tlb.map_gen);
+}
+
+// Pins the stack region [sbp, slp) in memory for direct access by stack and frame
+// operations, first unpinning the previous region if it has changed
+static void core_stack_pin(struct core *core, struct mem *mem)
+{
+	if (core->stack_addr != core->sbp || core->stack_end != core->slp) {
+		if (core->stack_end > core->stack_addr) {
+			mem_unpin(mem, core->stack_addr);
+		}
+		core->stack_addr = core->sbp;
+		core->stack_end = core->slp;
+	}
+	core->stack_host = NULL;
+	if (core->sbp >= END_IO_ADDR && core->slp > core->sbp) {
+		core->stack_host = mem_pin(mem, core->sbp, core->slp - core->sbp);
+	}
+	core->stack_gen = mem_map_gen(mem);
+}
+
+// Returns a host pointer for an access at the given address, which must be
+// within the stack bounds, or NULL if the stack region is not pinned
+static inline uint8_t *core_stack_host(struct core *core, struct mem *mem, uint64_t addr)
+{
+	if (core->stack_gen != mem_map_gen(mem)) {
+		core_stack_pin(core, mem);
+	}
+	return core->stack_host ? core->stack_host + (addr - core->stack_addr) : NULL;
+}
+
+// Checks that the range of len bytes at addr may be accessed in bulk. Returns 0 on
+// success.
+static int core_bulk_check(struct mem *mem, uint64_t addr, uint64_t len)
+{
+	if (addr < END_IO_ADDR) {
+		return STINT_BAD_IO_ACCESS;
+	}
+	if (addr > mem->size || len > mem->size - addr) {
+		return STINT_BAD_ADDR;
+	}
+	return 0;
+}
+
+// Returns the number of bytes from addr to the end of its page
+static inline uint64_t core_page_left(uint64_t addr)
+{
+	return MEM_PAGE_SIZE - (addr & MEM_PAGE_MASK);
+}
+
+// Returns host data for the len bytes at addr, which must lie within one page. The
+// last page may extend past the memory size and have no page data, in which case
+// its bytes are read into buf. Returns NULL on failure.
+static const uint8_t *core_bulk_data(struct mem *mem, uint64_t addr, uint64_t len, uint8_t *buf)
+{
+	const uint8_t *page = mem_page_data(mem, addr, 0);
+	if (page) {
+		return page + (addr & MEM_PAGE_MASK);
+	}
+	for (uint64_t i = 0; i < len; i++) {
+		if (mem_read8(mem, addr + i, buf + i)) return NULL;
+	}
+	return buf;
+}
+
+// Transfers file_len bytes between memory at file_addr and the host file fd, into
+// memory if out is zero and out of memory otherwise. Seekable files are accessed
+// at file_offset, others at their current position. Sets file_result to the number
+// of bytes transferred, which is less than file_len at the end of the file or when
+// fewer bytes are available, or to -1 if the host reports an error. Returns 0 on
+// success.
+static int core_io_transfer(struct core *core, struct mem *mem, int fd, int out, int seekable)
+{
+	struct core_io *io = &core->io;
+	int ret = core_bulk_check(mem, io->file_addr, io->file_len);
+	if (ret) return ret;
+	uint8_t buf[MEM_PAGE_SIZE];
+	uint64_t done = 0;
+	while (done < io->file_len) {
+		uint64_t addr = io->file_addr + done, chunk = io->file_len - done;
+		if (chunk > core_page_left(addr)) chunk = core_page_left(addr);
+		off_t offset = (off_t)(io->file_offset + done);
+		ssize_t bc;
+		if (out) {
+			const uint8_t *data = core_bulk_data(mem, addr, chunk, buf);
+			if (!data) return STINT_BAD_ADDR;
+			bc = seekable ? pwrite(fd, data, chunk, offset) : write(fd, data, chunk);
+		}
+		else {
+			// Read straight into the page, unless it is the last page and extends
+			// past the memory size
+			uint64_t map_gen = mem_map_gen(mem);
+			uint8_t *page = mem_page_data(mem, addr, 1);
+			uint8_t *dst = page ? page + (addr & MEM_PAGE_MASK) : buf;
+			bc = seekable ? pread(fd, dst, chunk, offset) : read(fd, dst, chunk);
+			if (page && bc > 0) core_note_written(mem, addr, bc, map_gen);
+			for (ssize_t i = 0; !page && i < bc; i++) {
+				if (mem_write8(mem, addr + i, buf[i])) return STINT_BAD_ADDR;
+			}
+		}
+		if (bc < 0) {
+			if (errno == EINTR) continue;
+			io->file_result = -1;
+			return 0;
+		}
+		done += bc;
+		if ((uint64_t)bc < chunk) break;
+	}
+	io->file_result = done;
+	return 0;
+}
+
+// Transfers data between memory and the selected file as core_io_transfer
+static int core_file_transfer(struct core *core, struct mem *mem, int out)
+{
+	if (core->group == NULL || core->io.file_select >= core->group->num_files) {
+		return STINT_BAD_IO_ACCESS;
+	}
+	return core_io_transfer(core, mem, core->group->files[core->io.file_select], out, 1);
+}
+
+// Reads from stdin into memory as core_io_transfer. Bytes already buffered by
+// reads of IO_STDIN_ADDR are returned first, without reading more.
+static int core_stdin_transfer(struct core *core, struct mem *mem)
+{
+	struct core_io *io = &core->io;
+	if (io->stdin_head == io->stdin_tail) {
+		return core_io_transfer(core, mem, 0, 0, 0);
+	}
+	int ret = core_bulk_check(mem, io->file_addr, io->file_len);
+	if (ret) return ret;
+	uint64_t count = io->stdin_tail - io->stdin_head;
+	if (count > io->file_len) count = io->file_len;
+	for (uint64_t i = 0; i < count; i++) {
+		if (mem_write8(mem, io->file_addr + i, io->stdin_buff[io->stdin_head + i])) {
+			return STINT_BAD_ADDR;
+		}
+	}
+	io->stdin_head += count;
+	io->file_result = count;
+	return 0;
+}
+
+// Writes memory to stdout as core_io_transfer, after any bytes buffered by writes
+// to IO_STDOUT_ADDR
+static int core_stdout_transfer(struct core *core, struct mem *mem)
+{
+	if (core->io.stdout_count) {
+		int ret = core_flush_stdout(core);
+		if (ret) return ret;
+	}
+	return core_io_transfer(core, mem, 1, 1, 0);
+}
+
+// Sets *size to the size of the selected file, or to -1 if the host reports an
+// error. Returns 0 on success.
+static int core_file_size(struct core *core, uint64_t *size)
+{
+	if (core->group == NULL || core->io.file_select >= core->group->num_files) {
+		return STINT_BAD_IO_ACCESS;
+	}
+	struct stat st;
+	*size = fstat(core->group->files[core->io.file_select], &st) ? (uint64_t)-1 : (uint64_t)st.st_size;
+	return 0;
+}
+
 static int core_mem_write8(struct core *core, struct mem *mem, uint64_t addr, uint8_t data)
 {
 	// Check IO memory
@@ -124,12 +488,56 @@ static int core_mem_write8(struct core *core, struct mem *mem, uint64_t addr, ui
 		if (addr == IO_ASSERT_ADDR) {
 			return data == 0 ? STINT_ASSERT_FAILURE : 0;
 		}
+		if (addr == IO_MAILBOX_TARGET_ADDR) {
+			if (data >= core->num_cores) {
+				return STINT_BAD_IO_ACCESS;
+			}
+			core->mailbox_target = data;
+			return 0;
+		}
+		if (addr == IO_FILE_SELECT_ADDR) {
+			if (core->group == NULL || data >= core->group->num_files) {
+				return STINT_BAD_IO_ACCESS;
+			}
+			core->io.file_select = data;
+			return 0;
+		}
+		if (addr == IO_FILE_READ_ADDR) {
+			return core_file_transfer(core, mem, 0);
+		}
+		if (addr == IO_FILE_WRITE_ADDR) {
+			return core_file_transfer(core, mem, 1);
+		}
+		if (addr == IO_STDIN_READ_ADDR) {
+			return core_stdin_transfer(core, mem);
+		}
+		if (addr == IO_STDOUT_WRITE_ADDR) {
+			return core_stdout_transfer(core, mem);
+		}
 		return STINT_BAD_IO_ACCESS;
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 1, 1);
+	if (ptr) {
+		*ptr = data;
+		core_tlb_written(core, mem, addr, 1);
+		return 0;
+	}
 	return mem_write8(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_write8(struct core *core, struct mem *mem, uint64_t addr, uint8_t data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		*ptr = data;
+		return 0;
+	}
+	return core_mem_write8(core, mem, addr, data);
+}
+
 static int core_frame_write8(struct core *core, struct mem *mem, uint64_t addr, uint8_t data)
 {
 	// Check stack frame bounds
@@ -141,7 +549,7 @@ static int core_frame_write8(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write8(core, mem, addr, data);
+	return core_unchecked_write8(core, mem, addr, data);
 }
 
 static int core_stack_write8(struct core *core, struct mem *mem, uint64_t addr, uint8_t data)
@@ -151,13 +559,11 @@ static int core_stack_write8(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write8(core, mem, addr, data);
+	return core_unchecked_write8(core, mem, addr, data);
 }
 
 static int core_mem_write16(struct core *core, struct mem *mem, uint64_t addr, uint16_t data)
 {
-	(void)core;
-
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_ASSERT_ADDR) {
@@ -166,9 +572,27 @@ static int core_mem_write16(struct core *core, struct mem *mem, uint64_t addr, u
 		return STINT_BAD_IO_ACCESS; // No 16-bit IO write operations currently
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 2, 1);
+	if (ptr) {
+		put_little16(data, ptr);
+		core_tlb_written(core, mem, addr, 2);
+		return 0;
+	}
 	return mem_write16(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_write16(struct core *core, struct mem *mem, uint64_t addr, uint16_t data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		put_little16(data, ptr);
+		return 0;
+	}
+	return core_mem_write16(core, mem, addr, data);
+}
+
 static int core_frame_write16(struct core *core, struct mem *mem, uint64_t addr, uint16_t data)
 {
 	// Check stack frame bounds
@@ -180,7 +604,7 @@ static int core_frame_write16(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write16(core, mem, addr, data);
+	return core_unchecked_write16(core, mem, addr, data);
 }
 
 static int core_stack_write16(struct core *core, struct mem *mem, uint64_t addr, uint16_t data)
@@ -190,13 +614,11 @@ static int core_stack_write16(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write16(core, mem, addr, data);
+	return core_unchecked_write16(core, mem, addr, data);
 }
 
 static int core_mem_write32(struct core *core, struct mem *mem, uint64_t addr, uint32_t data)
 {
-	(void)core;
-
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_ASSERT_ADDR) {
@@ -205,9 +627,27 @@ static int core_mem_write32(struct core *core, struct mem *mem, uint64_t addr, u
 		return STINT_BAD_IO_ACCESS; // No 32-bit IO write operations currently
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 4, 1);
+	if (ptr) {
+		put_little32(data, ptr);
+		core_tlb_written(core, mem, addr, 4);
+		return 0;
+	}
 	return mem_write32(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_write32(struct core *core, struct mem *mem, uint64_t addr, uint32_t data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		put_little32(data, ptr);
+		return 0;
+	}
+	return core_mem_write32(core, mem, addr, data);
+}
+
 static int core_frame_write32(struct core *core, struct mem *mem, uint64_t addr, uint32_t data)
 {
 	// Check stack frame bounds
@@ -219,7 +659,7 @@ static int core_frame_write32(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write32(core, mem, addr, data);
+	return core_unchecked_write32(core, mem, addr, data);
 }
 
 static int core_stack_write32(struct core *core, struct mem *mem, uint64_t addr, uint32_t data)
@@ -229,24 +669,82 @@ static int core_stack_write32(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write32(core, mem, addr, data);
+	return core_unchecked_write32(core, mem, addr, data);
 }
 
-static int core_mem_write64(struct core *core, struct mem *mem, uint64_t addr, uint64_t data)
+static int core_mem_read64(struct core *core, struct mem *mem, uint64_t addr, uint64_t *data);
+
+// Starts the next waiting core in the group with the start block at the given
+// address. Does nothing once all cores are started. Returns 0 on success.
+static int core_start_next(struct core *core, struct mem *mem, uint64_t addr)
 {
-	(void)core;
+	struct core_start start = { 0 };
+	int ret = core_mem_read64(core, mem, addr, &start.pc);
+	if (ret) return ret;
+	ret = core_mem_read64(core, mem, addr + 8, &start.sbp);
+	if (ret) return ret;
+	ret = core_mem_read64(core, mem, addr + 16, &start.slp);
+	if (ret) return ret;
+	if (!core->group) return 0;
+
+	int next = __atomic_fetch_add(&core->group->next_start, 1, __ATOMIC_RELAXED);
+	if (next >= core->group->count) return 0;
+	struct core *started = core->group->cores + next;
+	started->start = start;
+	__atomic_store_n(&started->start.ready, 1, __ATOMIC_RELEASE);
+	return 0;
+}
 
+static int core_mem_write64(struct core *core, struct mem *mem, uint64_t addr, uint64_t data)
+{
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_ASSERT_ADDR) {
 			return data == 0 ? STINT_ASSERT_FAILURE : 0;
 		}
-		return STINT_BAD_IO_ACCESS; // No 64-bit IO write operations currently
+		if (addr == IO_CORE_START_ADDR) {
+			return core_start_next(core, mem, data);
+		}
+		if (addr == IO_MAILBOX_SEND_ADDR) {
+			core_mailbox_send(core, data);
+			return 0;
+		}
+		if (addr == IO_FILE_ADDR_ADDR) {
+			core->io.file_addr = data;
+			return 0;
+		}
+		if (addr == IO_FILE_LEN_ADDR) {
+			core->io.file_len = data;
+			return 0;
+		}
+		if (addr == IO_FILE_OFFSET_ADDR) {
+			core->io.file_offset = data;
+			return 0;
+		}
+		return STINT_BAD_IO_ACCESS;
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 8, 1);
+	if (ptr) {
+		put_little64(data, ptr);
+		core_tlb_written(core, mem, addr, 8);
+		return 0;
+	}
 	return mem_write64(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_write64(struct core *core, struct mem *mem, uint64_t addr, uint64_t data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		put_little64(data, ptr);
+		return 0;
+	}
+	return core_mem_write64(core, mem, addr, data);
+}
+
 static int core_frame_write64(struct core *core, struct mem *mem, uint64_t addr, uint64_t data)
 {
 	// Check stack frame bounds
@@ -258,7 +756,7 @@ static int core_frame_write64(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write64(core, mem, addr, data);
+	return core_unchecked_write64(core, mem, addr, data);
 }
 
 static int core_stack_write64(struct core *core, struct mem *mem, uint64_t addr, uint64_t data)
@@ -268,7 +766,7 @@ static int core_stack_write64(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_write64(core, mem, addr, data);
+	return core_unchecked_write64(core, mem, addr, data);
 }
 
 static int core_mem_read8(struct core *core, struct mem *mem, uint64_t addr, uint8_t *data)
@@ -281,12 +779,49 @@ static int core_mem_read8(struct core *core, struct mem *mem, uint64_t addr, uin
 		if (addr == IO_URAND_ADDR) {
 			return core_get_random(data, sizeof(*data));
 		}
-		return STINT_BAD_IO_ACCESS; // No 8-bit IO read operations currently
+		if (addr == IO_CORE_ID_ADDR) {
+			*data = core->id;
+			return 0;
+		}
+		if (addr == IO_NUM_CORES_ADDR) {
+			*data = core->num_cores;
+			return 0;
+		}
+		if (addr == IO_MAILBOX_COUNT_ADDR) {
+			*data = core_mailbox_count(core);
+			return 0;
+		}
+		if (addr == IO_MAILBOX_WAIT_ADDR) {
+			*data = core_mailbox_wait(core);
+			return 0;
+		}
+		if (addr == IO_MAILBOX_SENT_ADDR) {
+			*data = core->mailbox_sent;
+			return 0;
+		}
+		return STINT_BAD_IO_ACCESS;
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 1, 0);
+	if (ptr) {
+		*data = *ptr;
+		return 0;
+	}
 	return mem_read8(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_read8(struct core *core, struct mem *mem, uint64_t addr, uint8_t *data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		*data = *ptr;
+		return 0;
+	}
+	return core_mem_read8(core, mem, addr, data);
+}
+
 static int core_frame_read8(struct core *core, struct mem *mem, uint64_t addr, uint8_t *data)
 {
 	// Check stack frame bounds
@@ -298,7 +833,7 @@ static int core_frame_read8(struct core *core, struct mem *mem, uint64_t addr, u
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read8(core, mem, addr, data);
+	return core_unchecked_read8(core, mem, addr, data);
 }
 
 static int core_stack_read8(struct core *core, struct mem *mem, uint64_t addr, uint8_t *data)
@@ -308,13 +843,11 @@ static int core_stack_read8(struct core *core, struct mem *mem, uint64_t addr, u
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read8(core, mem, addr, data);
+	return core_unchecked_read8(core, mem, addr, data);
 }
 
 static int core_mem_read16(struct core *core, struct mem *mem, uint64_t addr, uint16_t *data)
 {
-	(void)core;
-
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_URAND_ADDR) {
@@ -323,9 +856,26 @@ static int core_mem_read16(struct core *core, struct mem *mem, uint64_t addr, ui
 		return STINT_BAD_IO_ACCESS; // No 16-bit IO read operations currently
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 2, 0);
+	if (ptr) {
+		*data = get_little16(ptr);
+		return 0;
+	}
 	return mem_read16(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_read16(struct core *core, struct mem *mem, uint64_t addr, uint16_t *data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		*data = get_little16(ptr);
+		return 0;
+	}
+	return core_mem_read16(core, mem, addr, data);
+}
+
 static int core_frame_read16(struct core *core, struct mem *mem, uint64_t addr, uint16_t *data)
 {
 	// Check stack frame bounds
@@ -337,7 +887,7 @@ static int core_frame_read16(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read16(core, mem, addr, data);
+	return core_unchecked_read16(core, mem, addr, data);
 }
 
 static int core_stack_read16(struct core *core, struct mem *mem, uint64_t addr, uint16_t *data)
@@ -347,13 +897,11 @@ static int core_stack_read16(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read16(core, mem, addr, data);
+	return core_unchecked_read16(core, mem, addr, data);
 }
 
 static int core_mem_read32(struct core *core, struct mem *mem, uint64_t addr, uint32_t *data)
 {
-	(void)core;
-
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_URAND_ADDR) {
@@ -362,9 +910,26 @@ static int core_mem_read32(struct core *core, struct mem *mem, uint64_t addr, ui
 		return STINT_BAD_IO_ACCESS;
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 4, 0);
+	if (ptr) {
+		*data = get_little32(ptr);
+		return 0;
+	}
 	return mem_read32(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_read32(struct core *core, struct mem *mem, uint64_t addr, uint32_t *data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		*data = get_little32(ptr);
+		return 0;
+	}
+	return core_mem_read32(core, mem, addr, data);
+}
+
 static int core_frame_read32(struct core *core, struct mem *mem, uint64_t addr, uint32_t *data)
 {
 	// Check stack frame bounds
@@ -376,7 +941,7 @@ static int core_frame_read32(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read32(core, mem, addr, data);
+	return core_unchecked_read32(core, mem, addr, data);
 }
 
 static int core_stack_read32(struct core *core, struct mem *mem, uint64_t addr, uint32_t *data)
@@ -386,24 +951,50 @@ static int core_stack_read32(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read32(core, mem, addr, data);
+	return core_unchecked_read32(core, mem, addr, data);
 }
 
 static int core_mem_read64(struct core *core, struct mem *mem, uint64_t addr, uint64_t *data)
 {
-	(void)core;
-
 	// Check IO memory
 	if (addr < END_IO_ADDR) {
 		if (addr == IO_URAND_ADDR) {
 			return core_get_random(data, sizeof(*data));
 		}
-		return STINT_BAD_IO_ACCESS; // No 64-bit IO read operations currently
+		if (addr == IO_MAILBOX_RECV_ADDR) {
+			*data = core_mailbox_recv(core);
+			return 0;
+		}
+		if (addr == IO_FILE_RESULT_ADDR) {
+			*data = core->io.file_result;
+			return 0;
+		}
+		if (addr == IO_FILE_SIZE_ADDR) {
+			return core_file_size(core, data);
+		}
+		return STINT_BAD_IO_ACCESS;
 	}
 
+
+	uint8_t *ptr = core_tlb_translate(core, mem, addr, 8, 0);
+	if (ptr) {
+		*data = get_little64(ptr);
+		return 0;
+	}
 	return mem_read64(mem, addr, data);
 }
 
+// Accesses the stack at an address whose bounds the caller has checked
+static int core_unchecked_read64(struct core *core, struct mem *mem, uint64_t addr, uint64_t *data)
+{
+	uint8_t *ptr = core_stack_host(core, mem, addr);
+	if (ptr) {
+		*data = get_little64(ptr);
+		return 0;
+	}
+	return core_mem_read64(core, mem, addr, data);
+}
+
 static int core_frame_read64(struct core *core, struct mem *mem, uint64_t addr, uint64_t *data)
 {
 	// Check stack frame bounds
@@ -415,7 +1006,7 @@ static int core_frame_read64(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read64(core, mem, addr, data);
+	return core_unchecked_read64(core, mem, addr, data);
 }
 
 static int core_stack_read64(struct core *core, struct mem *mem, uint64_t addr, uint64_t *data)
@@ -425,2567 +1016,504 @@ static int core_stack_read64(struct core *core, struct mem *mem, uint64_t addr,
 		return STINT_BAD_STACK_ACCESS;
 	}
 
-	return core_mem_read64(core, mem, addr, data);
+	return core_unchecked_read64(core, mem, addr, data);
 }
 
-int core_step(struct core *core, struct mem *mem)
+// Returns the result of the given 64 bit comparison opcode on the given operands
+static uint64_t core_cmp64(int opcode, uint64_t a, uint64_t b)
 {
-	// Fetch instruction from memory
-	uint8_t opcode;
-	int ret = core_mem_read8(core, mem, core->pc, &opcode);
+	switch (opcode) {
+	case op_ceq64: return a == b;
+	case op_cne64: return a != b;
+	case op_cgtu64: return a > b;
+	case op_cgti64: return (int64_t)a > (int64_t)b;
+	case op_cltu64: return a < b;
+	case op_clti64: return (int64_t)a < (int64_t)b;
+	case op_cgeu64: return a >= b;
+	case op_cgei64: return (int64_t)a >= (int64_t)b;
+	case op_cleu64: return a <= b;
+	case op_clei64: return (int64_t)a <= (int64_t)b;
+	}
+	return 0;
+}
 
-	// Temporary variables for use by instructions
-	uint8_t temp_u8, temp_u8b;
-	uint16_t temp_u16, temp_u16b;
-	uint32_t temp_u32, temp_u32b;
-	uint64_t temp_u64, temp_u64b;
+// Sets *ptr to the host address of the aligned 64 bit word at addr for an atomic
+// access, which is completed with core_tlb_written. Returns 0 on success.
+static int core_atomic_ptr64(struct core *core, struct mem *mem, uint64_t addr, uint64_t **ptr)
+{
+	if (addr < END_IO_ADDR) {
+		return STINT_BAD_IO_ACCESS;
+	}
+	if (addr & 7) {
+		return STINT_BAD_ADDR;
+	}
+	uint8_t *host = core_tlb_translate(core, mem, addr, 8, 1);
+	if (!host) {
+		host = mem_page_data(mem, addr, 1);
+		if (!host) return STINT_BAD_ADDR;
+		host += addr & MEM_PAGE_MASK;
+	}
+	*ptr = (uint64_t*)host;
+	return 0;
+}
 
-	//
-	// Execute instruction on core and memory
-	//
-	if (ret == 0) switch (opcode) {
-	//
-	// Invalid instruction
-	//
-	case op_invalid:
-		ret = STINT_INVALID_INST;
-		break;
-
-	//
-	// Push immediate operations
-	//
-	case op_push8as8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 1;
-		core->pc += 2;
-		break;
-	case op_push8asu16:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 2;
-		break;
-	case op_push8asu32:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 2;
-		break;
-	case op_push8asu64:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 2;
-		break;
-	case op_push8asi16:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, (int8_t)temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 2;
-		break;
-	case op_push8asi32:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, (int8_t)temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 2;
-		break;
-	case op_push8asi64:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, (int8_t)temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 2;
-		break;
-	case op_push16as16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read imm
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 3;
-		break;
-	case op_push16asu32:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read imm
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 3;
-		break;
-	case op_push16asu64:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 3;
-		break;
-	case op_push16asi32:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read imm
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, (int16_t)temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 3;
-		break;
-	case op_push16asi64:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, (int16_t)temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 3;
-		break;
-	case op_push32as32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read imm
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 5;
-		break;
-	case op_push32asu64:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 5;
-		break;
-	case op_push32asi64:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, (int32_t)temp_u32); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 5;
-		break;
-	case op_push64as64:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read imm
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u64); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 9;
-		break;
-
-	//
-	// Pop operations
-	//
-	case op_pop8:
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_pop16:
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_pop32:
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_pop64:
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_popn:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64);
-		if (ret) break;
-		core->sp += -(int64_t)temp_u64 - 8;
-		core->pc += 1;
-		break;
-
-	//
-	// Duplication operations
-	//
-	case op_dup8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp, temp_u8);
-		if (ret) break;
-		core->sp += 1;
-		core->pc += 1;
-		break;
-	case op_dup16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16);
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, temp_u16);
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 1;
-		break;
-	case op_dup32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32);
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u32);
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 1;
-		break;
-	case op_dup64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u64);
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 1;
-		break;
-
-	//
-	// Setting operations
-	//
-	case op_set8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8);
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_set16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16);
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16);
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_set32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32);
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32);
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_set64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64);
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-
-	//
-	// Promotion operations
-	//
-	case op_prom8u32:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 1, temp_u8);
-		if (ret) break;
-		core->sp += 3;
-		core->pc += 1;
-		break;
-	case op_prom8u64:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 1, temp_u8);
-		if (ret) break;
-		core->sp += 7;
-		core->pc += 1;
-		break;
-	case op_prom8i16:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 1, (int8_t)temp_u8);
-		if (ret) break;
-		core->sp += 1;
-		core->pc += 1;
-		break;
-	case op_prom8i32:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 1, (int8_t)temp_u8);
-		if (ret) break;
-		core->sp += 3;
-		core->pc += 1;
-		break;
-	case op_prom8i64:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 1, (int8_t)temp_u8);
-		if (ret) break;
-		core->sp += 7;
-		core->pc += 1;
-		break;
-	case op_prom16u64:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 2, temp_u16);
-		if (ret) break;
-		core->sp += 6;
-		core->pc += 1;
-		break;
-	case op_prom16i32:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16);
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 2, (int16_t)temp_u16);
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 1;
-		break;
-	case op_prom16i64:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 2, (int16_t)temp_u16);
-		if (ret) break;
-		core->sp += 6;
-		core->pc += 1;
-		break;
-	case op_prom32i64:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32);
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 4, (int32_t)temp_u32);
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 1;
-		break;
-
-	//
-	// Demotion operations
-	//
-	case op_dem64to16:
-		core->sp -= 6;
-		core->pc += 1;
-		break;
-	case op_dem64to8:
-		core->sp -= 7;
-		core->pc += 1;
-		break;
-	case op_dem32to8:
-		core->sp -= 3;
-		core->pc += 1;
-		break;
-
-	//
-	// Integer arithmetic operations
-	//
-	case op_add8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 + temp_u8b); // Write sum
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_add16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 + temp_u16b); // Write sum
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_add32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 + temp_u32b); // Write sum
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_add64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 + temp_u64b); // Write sum
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_sub8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 - temp_u8b); // Write difference
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_sub16:
-		ret = core_frame_read16(core, mem, core->sp -2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 - temp_u16b); // Write difference
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_sub32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 - temp_u32b); // Write difference
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_sub64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 - temp_u64b); // Write difference
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_subr8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8b - temp_u8); // Write difference
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_subr16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16b - temp_u16); // Write difference
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_subr32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32b - temp_u32); // Write difference
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_subr64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64b - temp_u64); // Write difference
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_mul8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 * temp_u8b); // Write product
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_mul16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 * temp_u16b); // Write product
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_mul32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 * temp_u32b); // Write product
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_mul64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 * temp_u64b); // Write product
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_divu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 / temp_u8b); // Write quotient
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_divu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 / temp_u16b); // Write quotient
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_divu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 / temp_u32b); // Write quotient
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_divu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 / temp_u64b); // Write quotient
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_divru8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8b / temp_u8); // Write quotient
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_divru16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16b / temp_u16); // Write quotient
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_divru32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32b / temp_u32); // Write quotient
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_divru64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64b / temp_u64); // Write quotient
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_divi8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 / (int8_t)temp_u8b); // Write quotient
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_divi16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 / (int16_t)temp_u16b); // Write quotient
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_divi32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 / (int32_t)temp_u32b); // Write quotient
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_divi64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 / (int64_t)temp_u64b); // Write quotient
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_divri8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8b / (int8_t)temp_u8); // Write quotient
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_divri16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16b / (int16_t)temp_u16); // Write quotient
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_divri32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32b / (int32_t)temp_u32); // Write quotient
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_divri64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64b / (int64_t)temp_u64); // Write quotient
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_modu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 % temp_u8b); // Write remainder
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_modu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 % temp_u16b); // Write remainder
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_modu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 % temp_u32b); // Write remainder
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_modu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 % temp_u64b); // Write remainder
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_modru8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8b % temp_u8); // Write remainder
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_modru16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16b % temp_u16); // Write remainder
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_modru32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32b % temp_u32); // Write remainder
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_modru64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64b % temp_u64); // Write remainder
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_modi8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 % (int8_t)temp_u8b); // Write remainder
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_modi16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 % (int16_t)temp_u16b); // Write remainder
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_modi32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 % (int32_t)temp_u32b); // Write remainder
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_modi64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64b == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 % (int64_t)temp_u64b); // Write remainder
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_modri8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		if (temp_u8 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8b % (int8_t)temp_u8); // Write remainder
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_modri16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		if (temp_u16 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16b % (int16_t)temp_u16); // Write remainder
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_modri32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		if (temp_u32 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32b % (int32_t)temp_u32); // Write remainder
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_modri64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		if (temp_u64 == 0) {
-			ret = STINT_DIV_BY_ZERO;
-			break;
-		}
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64b % (int64_t)temp_u64); // Write remainder
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-
-	//
-	// Bitwise shift operations
-	//
-	case op_lshift8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 << temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_lshift16:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 3, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 3, temp_u16 << temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_lshift32:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 5, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 5, temp_u32 << temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_lshift64:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 9, temp_u64 << temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshiftu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshiftu16:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 3, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 3, temp_u16 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshiftu32:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 5, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 5, temp_u32 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshiftu64:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 9, temp_u64 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshifti8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshifti16:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 3, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 3, (int16_t)temp_u16 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshifti32:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 5, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 5, (int32_t)temp_u32 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_rshifti64:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 9, (int64_t)temp_u64 >> temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-
-	//
-	// Bitwise logical operations
-	//
-	case op_band8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 & temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_band16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 & temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_band32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 & temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_band64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 & temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_bor8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 | temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_bor16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 | temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_bor32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 | temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_bor64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 | temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_bxor8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 ^ temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_bxor16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 ^ temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_bxor32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 ^ temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_bxor64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 ^ temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_binv8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 1, ~temp_u8); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_binv16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 2, ~temp_u16); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_binv32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 4, ~temp_u32); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_binv64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 8, ~temp_u64); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-
-	//
-	// Boolean logical operations
-	//
-	case op_land8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 && temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_land16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 && temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_land32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 && temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_land64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 && temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_lor8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 || temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_lor16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 || temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_lor32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 || temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_lor64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 || temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_linv8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 1, !temp_u8); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_linv16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 2, !temp_u16); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_linv32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 4, !temp_u32); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_linv64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 8, !temp_u64); // Write result
-		if (ret) break;
-		core->pc += 1;
-		break;
-
-	//
-	// Comparison operations
-	//
-	case op_ceq8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 == temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_ceq16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 == temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_ceq32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 == temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_ceq64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 == temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cne8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 != temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cne16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 != temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cne32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 != temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cne64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 != temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cgtu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 > temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cgtu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 > temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cgtu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 > temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cgtu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 > temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cgti8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 > (int8_t)temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cgti16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 > (int16_t)temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cgti32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 > (int32_t)temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cgti64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 > (int64_t)temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cltu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 < temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cltu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 < temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cltu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 < temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cltu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 < temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_clti8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 < (int8_t)temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_clti16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 < (int16_t)temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_clti32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 < (int32_t)temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_clti64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 < (int64_t)temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cgeu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 >= temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cgeu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 >= temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cgeu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 >= temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cgeu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 >= temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cgei8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 >= (int8_t)temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cgei16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 >= (int16_t)temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cgei32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 >= (int32_t)temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cgei64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 >= (int64_t)temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_cleu8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, temp_u8 <= temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_cleu16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, temp_u16 <= temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_cleu32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32 <= temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_cleu64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, temp_u64 <= temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_clei8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8b); // Read operand
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 2, &temp_u8); // Read operand
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 2, (int8_t)temp_u8 <= (int8_t)temp_u8b); // Write result
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_clei16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read operand
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 4, &temp_u16); // Read operand
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 4, (int16_t)temp_u16 <= (int16_t)temp_u16b); // Write result
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_clei32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read operand
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 8, &temp_u32); // Read operand
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, (int32_t)temp_u32 <= (int32_t)temp_u32b); // Write result
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_clei64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read operand
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read operand
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 16, (int64_t)temp_u64 <= (int64_t)temp_u64b); // Write result
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
+// Compares the 64 bit word at the address below the expected and desired values
+// with the expected value and replaces it with the desired value if equal.
+// Replaces all three with the previous value.
+static int core_ext_cas64(struct core *core, struct mem *mem)
+{
+	uint64_t addr, expected, desired, *ptr;
+	int ret = core_frame_read64(core, mem, core->sp - 8, &desired);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 16, &expected);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 24, &addr);
+	if (ret) return ret;
+	ret = core_atomic_ptr64(core, mem, addr, &ptr);
+	if (ret) return ret;
+	// Guest memory is little-endian as on supported hosts
+	__atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	core_tlb_written(core, mem, addr, 8);
+	ret = core_frame_write64(core, mem, core->sp - 24, expected);
+	if (ret) return ret;
+	core->sp -= 16;
+	return 0;
+}
 
-	//
-	// Function operations
-	//
-	case op_call:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read imm address
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, core->sfp); // Push SFP
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp + 8, core->pc + 9); // Push RETA
-		if (ret) break;
-		core->sp += STACK_FRAME_METADATA_SIZE;
-		core->sfp = core->sp;
-		core->pc = temp_u64;
-		break;
-	case op_calls:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read and pop address
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 8, core->sfp); // Push SFP
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, core->pc + 1); // Push RETA
-		if (ret) break;
-		core->sp += STACK_FRAME_METADATA_SIZE - 8;
-		core->sfp = core->sp;
-		core->pc = temp_u64;
-		break;
-	case op_ret:
-		ret = core_stack_read64(core, mem, core->sfp - STACK_FRAME_METADATA_SIZE + 8, &temp_u64b); // Read RETA
-		if (ret) break;
-		ret = core_stack_read64(core, mem, core->sfp - STACK_FRAME_METADATA_SIZE, &temp_u64); // Read PSFP
-		if (ret) break;
-		core->sp = core->sfp - STACK_FRAME_METADATA_SIZE;
-		core->sfp = temp_u64;
-		core->pc = temp_u64b;
-		break;
+// Adds the top 64 bit popped to the 64 bit word at the address below, replacing
+// the address with the previous value
+static int core_ext_fetchadd64(struct core *core, struct mem *mem)
+{
+	uint64_t addr, val, *ptr;
+	int ret = core_frame_read64(core, mem, core->sp - 8, &val);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 16, &addr);
+	if (ret) return ret;
+	ret = core_atomic_ptr64(core, mem, addr, &ptr);
+	if (ret) return ret;
+	val = __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+	core_tlb_written(core, mem, addr, 8);
+	ret = core_frame_write64(core, mem, core->sp - 16, val);
+	if (ret) return ret;
+	core->sp -= 8;
+	return 0;
+}
 
-	//
-	// Jump operations
-	//
-	case op_jmp:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read imm address
-		if (ret) break;
-		core->pc = temp_u64;
-		break;
-	case op_jmps:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read and pop address
-		if (ret) break;
-		core->sp -= 8;
-		core->pc = temp_u64;
-		break;
-	case op_rjmpi8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read operand
-		if (ret) break;
-		core->pc += (int8_t)temp_u8;
-		break;
-	case op_rjmpi16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read operand
-		if (ret) break;
-		core->pc += (int16_t)temp_u16;
-		break;
-	case op_rjmpi32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read operand
-		if (ret) break;
-		core->pc += (int32_t)temp_u32;
-		break;
+// Completes all memory accesses before the fence before any after it
+static int core_ext_fence(struct core *core, struct mem *mem)
+{
+	(void)core;
+	(void)mem;
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return 0;
+}
 
-	//
-	// Branching operations
-	//
-	case op_rbrz8i8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8b); // Read offset
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read condition
-		if (ret) break;
-		core->sp -= 1;
-		if (temp_u8) {
-			core->pc += 2;
-		}
-		else {
-			core->pc += (int8_t)temp_u8b;
-		}
-		break;
-	case op_rbrz8i16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read offset
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read condition
-		if (ret) break;
-		core->sp -= 1;
-		if (temp_u8) {
-			core->pc += 3;
-		}
-		else {
-			core->pc += (int16_t)temp_u16;
-		}
-		break;
-	case op_rbrz8i32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read offset
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read condition
-		if (ret) break;
-		core->sp -= 1;
-		if (temp_u8) {
-			core->pc += 5;
-		}
-		else {
-			core->pc += (int32_t)temp_u32;
-		}
-		break;
-	case op_rbrz16i8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read offset
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read condition
-		if (ret) break;
-		core->sp -= 2;
-		if (temp_u16) {
-			core->pc += 2;
-		}
-		else {
-			core->pc += (int8_t)temp_u8;
-		}
-		break;
-	case op_rbrz16i16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read offset
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16b); // Read condition
-		if (ret) break;
-		core->sp -= 2;
-		if (temp_u16b) {
-			core->pc += 3;
-		}
-		else {
-			core->pc += (int16_t)temp_u16;
-		}
-		break;
-	case op_rbrz16i32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read offset
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read condition
-		if (ret) break;
-		core->sp -= 2;
-		if (temp_u16) {
-			core->pc += 5;
-		}
-		else {
-			core->pc += (int32_t)temp_u32;
-		}
-		break;
-	case op_rbrz32i8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read offset
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read condition
-		if (ret) break;
-		core->sp -= 4;
-		if (temp_u32) {
-			core->pc += 2;
-		}
-		else {
-			core->pc += (int8_t)temp_u8;
-		}
-		break;
-	case op_rbrz32i16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read offset
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read condition
-		if (ret) break;
-		core->sp -= 4;
-		if (temp_u32) {
-			core->pc += 3;
-		}
-		else {
-			core->pc += (int16_t)temp_u16;
-		}
-		break;
-	case op_rbrz32i32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read offset
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32b); // Read condition
-		if (ret) break;
-		core->sp -= 4;
-		if (temp_u32b) {
-			core->pc += 5;
-		}
-		else {
-			core->pc += (int32_t)temp_u32;
-		}
-		break;
-	case op_rbrz64i8:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read offset
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read condition
-		if (ret) break;
-		core->sp -= 8;
-		if (temp_u64) {
-			core->pc += 2;
-		}
-		else {
-			core->pc += (int8_t)temp_u8;
-		}
-		break;
-	case op_rbrz64i16:
-		ret = core_mem_read16(core, mem, core->pc + 1, &temp_u16); // Read offset
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read condition
-		if (ret) break;
-		core->sp -= 8;
-		if (temp_u64) {
-			core->pc += 3;
-		}
-		else {
-			core->pc += (int16_t)temp_u16;
-		}
-		break;
-	case op_rbrz64i32:
-		ret = core_mem_read32(core, mem, core->pc + 1, &temp_u32); // Read offset
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read condition
-		if (ret) break;
-		core->sp -= 8;
-		if (temp_u64) {
-			core->pc += 5;
+// Copies len bytes from src to dst a page at a time. With ascending set the
+// pages are copied from the lowest addresses, otherwise from the highest.
+static int core_bulk_copy(struct mem *mem, uint64_t dst, uint64_t src,
+	uint64_t len, int ascending)
+{
+	int ret = core_bulk_check(mem, dst, len);
+	if (ret) return ret;
+	ret = core_bulk_check(mem, src, len);
+	if (ret) return ret;
+	while (len) {
+		uint64_t chunk = len, d = dst, s = src;
+		if (ascending) {
+			if (chunk > core_page_left(d)) chunk = core_page_left(d);
+			if (chunk > core_page_left(s)) chunk = core_page_left(s);
 		}
 		else {
-			core->pc += (int32_t)temp_u32;
+			// Copy the bytes remaining within the last pages of the ranges
+			uint64_t d_last = ((d + len - 1) & MEM_PAGE_MASK) + 1;
+			uint64_t s_last = ((s + len - 1) & MEM_PAGE_MASK) + 1;
+			if (chunk > d_last) chunk = d_last;
+			if (chunk > s_last) chunk = s_last;
+			d += len - chunk;
+			s += len - chunk;
+		}
+		// The destination page is allocated first, so that the source pointer is
+		// not to the zero page if they are the same page
+		uint64_t map_gen = mem_map_gen(mem);
+		uint8_t *dst_page = mem_page_data(mem, d, 1);
+		const uint8_t *src_page = mem_page_data(mem, s, 0);
+		if (dst_page && src_page) {
+			memmove(dst_page + (d & MEM_PAGE_MASK), src_page + (s & MEM_PAGE_MASK), chunk);
+			core_note_written(mem, d, chunk, map_gen);
 		}
-		break;
+		else {
+			// The last page extends past the memory size, so copy a byte at a time
+			for (uint64_t i = 0; i < chunk; i++) {
+				uint64_t off = ascending ? i : chunk - 1 - i;
+				uint8_t byte;
+				if (mem_read8(mem, s + off, &byte) || mem_write8(mem, d + off, byte)) {
+					return STINT_BAD_ADDR;
+				}
+			}
+		}
+		if (ascending) {
+			dst += chunk;
+			src += chunk;
+		}
+		len -= chunk;
+	}
+	return 0;
+}
 
-	//
-	// Memory operations
-	//
-	case op_load8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read8(core, mem, temp_u64b, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 1;
-		core->pc += 1;
-		break;
-	case op_load16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read16(core, mem, temp_u64b, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 1;
-		break;
-	case op_load32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read32(core, mem, temp_u64b, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 1;
-		break;
-	case op_load64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read64(core, mem, temp_u64b, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u64); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 1;
-		break;
-	case op_loadpop8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read8(core, mem, temp_u64b, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 8, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp -= 7;
-		core->pc += 1;
-		break;
-	case op_loadpop16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read16(core, mem, temp_u64b, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 8, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp -= 6;
-		core->pc += 1;
-		break;
-	case op_loadpop32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read32(core, mem, temp_u64b, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_loadpop64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_read64(core, mem, temp_u64b, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 8, temp_u64); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_loadsfp8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read8(core, mem, core->sfp + (int64_t)temp_u64, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp += 1;
-		core->pc += 1;
-		break;
-	case op_loadsfp16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read16(core, mem, core->sfp + (int64_t)temp_u64, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp += 2;
-		core->pc += 1;
-		break;
-	case op_loadsfp32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read32(core, mem, core->sfp + (int64_t)temp_u64, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp += 4;
-		core->pc += 1;
-		break;
-	case op_loadsfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read64(core, mem, core->sfp + (int64_t)temp_u64, &temp_u64b); // Read data
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp, temp_u64b); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 1;
-		break;
-	case op_loadpopsfp8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read8(core, mem, core->sfp + (int64_t)temp_u64, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_write8(core, mem, core->sp - 8, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp -= 7;
-		core->pc += 1;
-		break;
-	case op_loadpopsfp16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read16(core, mem, core->sfp + (int64_t)temp_u64, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_write16(core, mem, core->sp - 8, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp -= 6;
-		core->pc += 1;
-		break;
-	case op_loadpopsfp32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read32(core, mem, core->sfp + (int64_t)temp_u64, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_write32(core, mem, core->sp - 8, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_loadpopsfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_read64(core, mem, core->sfp + (int64_t)temp_u64, &temp_u64b); // Read data
-		if (ret) break;
-		ret = core_frame_write64(core, mem, core->sp - 8, temp_u64b); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_store8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write8(core, mem, temp_u64b, temp_u8); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_store16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 10, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write16(core, mem, temp_u64b, temp_u16); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_store32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 12, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write32(core, mem, temp_u64b, temp_u32); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_store64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write64(core, mem, temp_u64b, temp_u64); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storepop8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write8(core, mem, temp_u64b, temp_u8); // Write to memory
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_storepop16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 10, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write16(core, mem, temp_u64b, temp_u16); // Write to memory
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_storepop32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 12, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write32(core, mem, temp_u64b, temp_u32); // Write to memory
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_storepop64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_mem_write64(core, mem, temp_u64b, temp_u64); // Write to memory
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storesfp8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write8(core, mem, core->sfp + (int64_t)temp_u64, temp_u8); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storesfp16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 10, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write16(core, mem, core->sfp + (int64_t)temp_u64, temp_u16); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storesfp32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 12, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write32(core, mem, core->sfp + (int64_t)temp_u64, temp_u32); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storesfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write64(core, mem, core->sfp + (int64_t)temp_u64, temp_u64b); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storepopsfp8:
-		ret = core_frame_read8(core, mem, core->sp - 1, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 9, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write8(core, mem, core->sfp + (int64_t)temp_u64, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp -= 1;
-		core->pc += 1;
-		break;
-	case op_storepopsfp16:
-		ret = core_frame_read16(core, mem, core->sp - 2, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 10, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write16(core, mem, core->sfp + (int64_t)temp_u64, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp -= 2;
-		core->pc += 1;
-		break;
-	case op_storepopsfp32:
-		ret = core_frame_read32(core, mem, core->sp - 4, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 12, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write32(core, mem, core->sfp + (int64_t)temp_u64, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp -= 4;
-		core->pc += 1;
-		break;
-	case op_storepopsfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read data
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read offset
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write64(core, mem, core->sfp + (int64_t)temp_u64, temp_u64b); // Write to stack
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storer8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 9, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_mem_write8(core, mem, temp_u64b, temp_u8); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storer16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 10, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_mem_write16(core, mem, temp_u64b, temp_u16); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storer32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 12, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_mem_write32(core, mem, temp_u64b, temp_u32); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storer64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_mem_write64(core, mem, temp_u64b, temp_u64); // Write to memory
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storerpop8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 9, &temp_u8); // Read data
-		if (ret) break;
-		ret = core_mem_write8(core, mem, temp_u64b, temp_u8); // Write to memory
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpop16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 10, &temp_u16); // Read data
-		if (ret) break;
-		ret = core_mem_write16(core, mem, temp_u64b, temp_u16); // Write to memory
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpop32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 12, &temp_u32); // Read data
-		if (ret) break;
-		ret = core_mem_write32(core, mem, temp_u64b, temp_u32); // Write to memory
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpop64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64b); // Read addr
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64); // Read data
-		if (ret) break;
-		ret = core_mem_write64(core, mem, temp_u64b, temp_u64); // Write to memory
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storersfp8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 9, &temp_u8); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write8(core, mem, core->sfp + (int64_t)temp_u64, temp_u8); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storersfp16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 10, &temp_u16); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write16(core, mem, core->sfp + (int64_t)temp_u64, temp_u16); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storersfp32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 12, &temp_u32); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write32(core, mem, core->sfp + (int64_t)temp_u64, temp_u32); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storersfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64b); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write64(core, mem, core->sfp + (int64_t)temp_u64, temp_u64b); // Write to stack
-		if (ret) break;
-		core->pc += 1;
-		break;
-	case op_storerpopsfp8:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read8(core, mem, core->sp - 9, &temp_u8); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
-		}
-		ret = core_stack_write8(core, mem, core->sfp + (int64_t)temp_u64, temp_u8); // Write to stack
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpopsfp16:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read16(core, mem, core->sp - 10, &temp_u16); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
+// Reads the address and length operands of a bulk operation, below which are
+// other operands of size bytes
+static int core_bulk_operands(struct core *core, struct mem *mem, uint64_t size,
+	uint64_t *addr, uint64_t *len)
+{
+	int ret = core_frame_read64(core, mem, core->sp - 8, len);
+	if (ret) return ret;
+	return core_frame_read64(core, mem, core->sp - 16 - size, addr);
+}
+
+// Copies bytes between the ranges, which must not overlap
+static int core_ext_memcpy(struct core *core, struct mem *mem)
+{
+	uint64_t dst, src, len;
+	int ret = core_bulk_operands(core, mem, 8, &dst, &len);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 16, &src);
+	if (ret) return ret;
+	ret = core_bulk_copy(mem, dst, src, len, 1);
+	if (ret) return ret;
+	core->sp -= 24;
+	return 0;
+}
+
+// Copies bytes between the ranges, which may overlap
+static int core_ext_memmove(struct core *core, struct mem *mem)
+{
+	uint64_t dst, src, len;
+	int ret = core_bulk_operands(core, mem, 8, &dst, &len);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 16, &src);
+	if (ret) return ret;
+	// Copy from the highest addresses when the destination overlaps the end of the source
+	ret = core_bulk_copy(mem, dst, src, len, dst <= src || dst - src >= len);
+	if (ret) return ret;
+	core->sp -= 24;
+	return 0;
+}
+
+// Fills the range with a byte value
+static int core_ext_memset(struct core *core, struct mem *mem)
+{
+	uint64_t dst, len;
+	uint8_t val;
+	int ret = core_bulk_operands(core, mem, 1, &dst, &len);
+	if (ret) return ret;
+	ret = core_frame_read8(core, mem, core->sp - 9, &val);
+	if (ret) return ret;
+	ret = core_bulk_check(mem, dst, len);
+	if (ret) return ret;
+	while (len) {
+		uint64_t chunk = len < core_page_left(dst) ? len : core_page_left(dst);
+		uint64_t map_gen = mem_map_gen(mem);
+		uint8_t *page = mem_page_data(mem, dst, 1);
+		if (page) {
+			memset(page + (dst & MEM_PAGE_MASK), val, chunk);
+			core_note_written(mem, dst, chunk, map_gen);
 		}
-		ret = core_stack_write16(core, mem, core->sfp + (int64_t)temp_u64, temp_u16); // Write to stack
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpopsfp32:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read32(core, mem, core->sp - 12, &temp_u32); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
+		else {
+			// The last page extends past the memory size
+			for (uint64_t i = 0; i < chunk; i++) {
+				if (mem_write8(mem, dst + i, val)) return STINT_BAD_ADDR;
+			}
 		}
-		ret = core_stack_write32(core, mem, core->sfp + (int64_t)temp_u64, temp_u32); // Write to stack
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
-		break;
-	case op_storerpopsfp64:
-		ret = core_frame_read64(core, mem, core->sp - 8, &temp_u64); // Read offset
-		if (ret) break;
-		ret = core_frame_read64(core, mem, core->sp - 16, &temp_u64b); // Read data
-		if (ret) break;
-		if ((int64_t)temp_u64 < 0) {
-			temp_u64 -= STACK_FRAME_METADATA_SIZE;
+		dst += chunk;
+		len -= chunk;
+	}
+	core->sp -= 17;
+	return 0;
+}
+
+// Compares the ranges bytewise as unsigned values
+static int core_ext_memcmp(struct core *core, struct mem *mem)
+{
+	uint64_t a, b, len;
+	int ret = core_bulk_operands(core, mem, 8, &a, &len);
+	if (ret) return ret;
+	ret = core_frame_read64(core, mem, core->sp - 16, &b);
+	if (ret) return ret;
+	ret = core_bulk_check(mem, a, len);
+	if (ret) return ret;
+	ret = core_bulk_check(mem, b, len);
+	if (ret) return ret;
+	int64_t cmp = 0;
+	uint8_t a_buf[MEM_PAGE_SIZE], b_buf[MEM_PAGE_SIZE];
+	while (len && !cmp) {
+		uint64_t chunk = len;
+		if (chunk > core_page_left(a)) chunk = core_page_left(a);
+		if (chunk > core_page_left(b)) chunk = core_page_left(b);
+		const uint8_t *a_data = core_bulk_data(mem, a, chunk, a_buf);
+		const uint8_t *b_data = core_bulk_data(mem, b, chunk, b_buf);
+		if (!a_data || !b_data) return STINT_BAD_ADDR;
+		uint64_t i = scan_diff(a_data, b_data, chunk);
+		if (i < chunk) {
+			cmp = a_data[i] < b_data[i] ? -1 : 1;
+		}
+		a += chunk;
+		b += chunk;
+		len -= chunk;
+	}
+	ret = core_frame_write64(core, mem, core->sp - 24, cmp);
+	if (ret) return ret;
+	core->sp -= 16;
+	return 0;
+}
+
+// Finds the first zero byte at or after the address, which must lie within memory
+static int core_ext_strlen(struct core *core, struct mem *mem)
+{
+	uint64_t addr;
+	int ret = core_frame_read64(core, mem, core->sp - 8, &addr);
+	if (ret) return ret;
+	if (addr < END_IO_ADDR) {
+		return STINT_BAD_IO_ACCESS;
+	}
+	ret = core_bulk_check(mem, addr, mem->size > addr ? mem->size - addr : 0);
+	if (ret) return ret;
+	uint8_t buf[MEM_PAGE_SIZE];
+	uint64_t len = 0;
+	for (;;) {
+		uint64_t next = addr + len;
+		if (next >= mem->size) {
+			return STINT_BAD_ADDR; // No terminator before the end of memory
+		}
+		uint64_t chunk = core_page_left(next);
+		if (chunk > mem->size - next) chunk = mem->size - next;
+		const uint8_t *data = core_bulk_data(mem, next, chunk, buf);
+		if (!data) return STINT_BAD_ADDR;
+		uint64_t i = scan_byte(data, chunk, 0);
+		len += i;
+		if (i < chunk) break;
+	}
+	return core_frame_write64(core, mem, core->sp - 8, len);
+}
+
+// Finds the first byte in the range equal to a byte value
+static int core_ext_memchr(struct core *core, struct mem *mem)
+{
+	uint64_t addr, len;
+	uint8_t val;
+	int ret = core_bulk_operands(core, mem, 1, &addr, &len);
+	if (ret) return ret;
+	ret = core_frame_read8(core, mem, core->sp - 9, &val);
+	if (ret) return ret;
+	ret = core_bulk_check(mem, addr, len);
+	if (ret) return ret;
+	uint8_t buf[MEM_PAGE_SIZE];
+	uint64_t found = 0;
+	while (len) {
+		uint64_t chunk = len < core_page_left(addr) ? len : core_page_left(addr);
+		const uint8_t *data = core_bulk_data(mem, addr, chunk, buf);
+		if (!data) return STINT_BAD_ADDR;
+		uint64_t i = scan_byte(data, chunk, val);
+		if (i < chunk) {
+			found = addr + i;
+			break;
 		}
-		ret = core_stack_write64(core, mem, core->sfp + (int64_t)temp_u64, temp_u64b); // Write to stack
-		if (ret) break;
-		core->sp -= 8;
-		core->pc += 1;
+		addr += chunk;
+		len -= chunk;
+	}
+	ret = core_frame_write64(core, mem, core->sp - 17, found);
+	if (ret) return ret;
+	core->sp -= 9;
+	return 0;
+}
+
+// Vectors of unsigned and signed lanes of each width, for the vector operations
+typedef uint8_t core_vu8 __attribute__((vector_size(16)));
+typedef uint16_t core_vu16 __attribute__((vector_size(16)));
+typedef uint32_t core_vu32 __attribute__((vector_size(16)));
+typedef uint64_t core_vu64 __attribute__((vector_size(16)));
+typedef int8_t core_vi8 __attribute__((vector_size(16)));
+typedef int16_t core_vi16 __attribute__((vector_size(16)));
+typedef int32_t core_vi32 __attribute__((vector_size(16)));
+typedef int64_t core_vi64 __attribute__((vector_size(16)));
+
+// Reads the two vectors at the top of the stack into a and b. They are read as
+// 64-bit words, so lanes may be reordered within a word on big-endian hosts,
+// which lanewise operations do not notice.
+static int core_vec_operands(struct core *core, struct mem *mem, void *a, void *b)
+{
+	uint64_t words[4];
+	for (int i = 0; i < 4; i++) {
+		int ret = core_frame_read64(core, mem, core->sp - 32 + 8 * i, &words[i]);
+		if (ret) return ret;
+	}
+	memcpy(a, words, 16);
+	memcpy(b, words + 2, 16);
+	return 0;
+}
+
+// Replaces the two vectors at the top of the stack with the vector r
+static int core_vec_result(struct core *core, struct mem *mem, const void *r)
+{
+	uint64_t words[2];
+	memcpy(words, r, 16);
+	for (int i = 0; i < 2; i++) {
+		int ret = core_frame_write64(core, mem, core->sp - 32 + 8 * i, words[i]);
+		if (ret) return ret;
+	}
+	core->sp -= 16;
+	return 0;
+}
+
+// Each CORE_EXT_GEN_<kind>(name, bits, expr) implements the vector operations of
+// a kind from starch_ext_ops.ct, computing the result lanes from a and b
+#define CORE_EXT_GEN_LANES(name, bits, result) \
+static int core_ext_##name(struct core *core, struct mem *mem) \
+{ \
+	core_vu##bits a, b; \
+	int ret = core_vec_operands(core, mem, &a, &b); \
+	if (ret) return ret; \
+	core_vi##bits sa = (core_vi##bits)a, sb = (core_vi##bits)b; \
+	(void)sa, (void)sb; \
+	core_vu##bits r = result; \
+	return core_vec_result(core, mem, &r); \
+}
+#define CORE_EXT_GEN_VECTOR(name, bits, expr) CORE_EXT_GEN_LANES(name, bits, (expr))
+#define CORE_EXT_GEN_VCOMPARE(name, bits, expr) CORE_EXT_GEN_LANES(name, bits, (core_vu##bits)(expr) & 1)
+#define CORE_EXT_GEN_VSELECT(name, bits, expr) \
+	CORE_EXT_GEN_LANES(name, bits, (a & (core_vu##bits)(expr)) | (b & ~(core_vu##bits)(expr)))
+#define CORE_EXT_GEN_CUSTOM(name, bits, expr)
+
+#define STARCH_EXT_OP(name, imm, pop, push, flags, kind, bits, expr) \
+	CORE_EXT_GEN_##kind(name, bits, expr)
+#include "starch_ext_ops.ct"
+#undef STARCH_EXT_OP
+
+#undef CORE_EXT_GEN_LANES
+#undef CORE_EXT_GEN_VECTOR
+#undef CORE_EXT_GEN_VCOMPARE
+#undef CORE_EXT_GEN_VSELECT
+#undef CORE_EXT_GEN_CUSTOM
+
+// Executes the extended operation with the given extended opcode and advances pc
+// past it. Returns as core_step.
+static int core_ext(struct core *core, struct mem *mem, uint8_t extop)
+{
+	int ret;
+	switch (extop) {
+#define STARCH_EXT_OP(name, imm, pop, push, flags, kind, bits, expr) \
+	case opx_##name: ret = core_ext_##name(core, mem); break;
+#include "starch_ext_ops.ct"
+#undef STARCH_EXT_OP
+	default:
+		return STINT_INVALID_INST;
+	}
+	if (ret == 0) {
+		core->pc += 2;
+	}
+	return ret;
+}
+
+// Immediate arguments are read from memory following the opcode
+#define CORE_READ_IMM8(data) core_mem_read8(core, mem, core->pc + 1, data)
+#define CORE_READ_IMM16(data) core_mem_read16(core, mem, core->pc + 1, data)
+#define CORE_READ_IMM32(data) core_mem_read32(core, mem, core->pc + 1, data)
+#define CORE_READ_IMM64(data) core_mem_read64(core, mem, core->pc + 1, data)
+
+// Returns whether [sp - below, sp + above) is within both the frame and the stack,
+// so that any frame access within it would pass its bounds checks
+static inline int core_frame_fits(const struct core *core, uint64_t below, uint64_t above)
+{
+	uint64_t lo = core->sfp > core->sbp ? core->sfp : core->sbp;
+	uint64_t span = core->slp > lo ? core->slp - lo : 0;
+	return span >= below + above && core->sp - lo - below <= span - (below + above);
+}
+
+// Checked frame accesses for core_step_checked
+#define CORE_FRAME_CHECK(below, above)
+#define CORE_FRAME_READ8(addr, data) core_frame_read8(core, mem, addr, data)
+#define CORE_FRAME_READ16(addr, data) core_frame_read16(core, mem, addr, data)
+#define CORE_FRAME_READ32(addr, data) core_frame_read32(core, mem, addr, data)
+#define CORE_FRAME_READ64(addr, data) core_frame_read64(core, mem, addr, data)
+#define CORE_FRAME_WRITE8(addr, data) core_frame_write8(core, mem, addr, data)
+#define CORE_FRAME_WRITE16(addr, data) core_frame_write16(core, mem, addr, data)
+#define CORE_FRAME_WRITE32(addr, data) core_frame_write32(core, mem, addr, data)
+#define CORE_FRAME_WRITE64(addr, data) core_frame_write64(core, mem, addr, data)
+
+// Executes a single instruction as core_step does, checking the bounds of each
+// frame access individually, but without vectoring interrupts. Used for operations
+// whose hoisted bounds check failed, so that they raise the same interrupt.
+static int core_step_checked(struct core *core, struct mem *mem)
+{
+	// Fetch instruction from memory
+	uint8_t opcode;
+	int ret = core_mem_read8(core, mem, core->pc, &opcode);
+
+	// Temporary variables for use by instructions
+	uint8_t temp_u8, temp_u8b;
+	uint16_t temp_u16, temp_u16b;
+	uint32_t temp_u32, temp_u32b;
+	uint64_t temp_u64, temp_u64b;
+
+	if (ret == 0) switch (opcode) {
+#define CORE_OP(op) case op:
+#define CORE_OP_END break;
+#include "core_ops.ct"
+#undef CORE_OP
+#undef CORE_OP_END
+
+	default:
+		ret = STINT_INVALID_INST;
 		break;
+	}
+	return ret;
+}
+
+#undef CORE_FRAME_CHECK
+#undef CORE_FRAME_READ8
+#undef CORE_FRAME_READ16
+#undef CORE_FRAME_READ32
+#undef CORE_FRAME_READ64
+#undef CORE_FRAME_WRITE8
+#undef CORE_FRAME_WRITE16
+#undef CORE_FRAME_WRITE32
+#undef CORE_FRAME_WRITE64
+
+// The other engines check the bounds of an operation's frame accesses once, and
+// execute it with core_step_checked if the check fails
+#define CORE_FRAME_CHECK(below, above) if (!core_frame_fits(core, below, above)) { \
+	ret = core_step_checked(core, mem); \
+	break; \
+}
+#define CORE_FRAME_READ8(addr, data) core_unchecked_read8(core, mem, addr, data)
+#define CORE_FRAME_READ16(addr, data) core_unchecked_read16(core, mem, addr, data)
+#define CORE_FRAME_READ32(addr, data) core_unchecked_read32(core, mem, addr, data)
+#define CORE_FRAME_READ64(addr, data) core_unchecked_read64(core, mem, addr, data)
+#define CORE_FRAME_WRITE8(addr, data) core_unchecked_write8(core, mem, addr, data)
+#define CORE_FRAME_WRITE16(addr, data) core_unchecked_write16(core, mem, addr, data)
+#define CORE_FRAME_WRITE32(addr, data) core_unchecked_write32(core, mem, addr, data)
+#define CORE_FRAME_WRITE64(addr, data) core_unchecked_write64(core, mem, addr, data)
+
+int core_step(struct core *core, struct mem *mem)
+{
+	// Fetch instruction from memory
+	uint8_t opcode;
+	int ret = core_mem_read8(core, mem, core->pc, &opcode);
+
+	// Temporary variables for use by instructions
+	uint8_t temp_u8, temp_u8b;
+	uint16_t temp_u16, temp_u16b;
+	uint32_t temp_u32, temp_u32b;
+	uint64_t temp_u64, temp_u64b;
 
 	//
-	// Special Operations
+	// Execute instruction on core and memory
 	//
-	case op_pushsfp:
-		ret = core_frame_write64(core, mem, core->sp, core->sfp); // Write to stack
-		if (ret) break;
-		core->sp += 8;
-		core->pc += 1;
-		break;
-	case op_setsbp:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read addr
-		if (ret) break;
-		core->sbp = temp_u64;
-		core->pc += 9;
-		break;
-	case op_setsfp:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read addr
-		if (ret) break;
-		core->sfp = temp_u64;
-		core->pc += 9;
-		break;
-	case op_setsp:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read addr
-		if (ret) break;
-		core->sp = temp_u64;
-		core->pc += 9;
-		break;
-	case op_setslp:
-		ret = core_mem_read64(core, mem, core->pc + 1, &temp_u64); // Read addr
-		if (ret) break;
-		core->slp = temp_u64;
-		core->pc += 9;
-		break;
-	case op_halt:
-		ret = core_mem_read8(core, mem, core->pc + 1, &temp_u8); // Read exit code imm
-		if (ret) break;
-		core_flush_stdout(core);
-		ret = 256 + temp_u8;
-		break;
-	case op_ext:
-		// @todo
-		ret = -1;
-		break;
-	case op_nop:
-		core->pc += 1;
-		break;
+	if (ret == 0) switch (opcode) {
+#define CORE_OP(op) case op:
+#define CORE_OP_END break;
+#include "core_ops.ct"
+#undef CORE_OP
+#undef CORE_OP_END
 
 	default:
 		ret = STINT_INVALID_INST;
@@ -3000,3 +1528,501 @@ int core_step(struct core *core, struct mem *mem)
 
 	return ret;
 }
+
+// Define a core_run_threaded variant with and without a stop filter
+#define CORE_THREADED_NAME core_run_threaded_plain
+#define CORE_THREADED_STOP 0
+#include "core_threaded.ct"
+#undef CORE_THREADED_NAME
+#undef CORE_THREADED_STOP
+
+#define CORE_THREADED_NAME core_run_threaded_stop
+#define CORE_THREADED_STOP 1
+#include "core_threaded.ct"
+#undef CORE_THREADED_NAME
+#undef CORE_THREADED_STOP
+
+int core_run_threaded(struct core *core, struct mem *mem, uint64_t *budget,
+	const struct bpfilter *stop)
+{
+	if (stop) return core_run_threaded_stop(core, mem, budget, stop);
+	return core_run_threaded_plain(core, mem, budget, stop);
+}
+
+#undef CORE_READ_IMM8
+#undef CORE_READ_IMM16
+#undef CORE_READ_IMM32
+#undef CORE_READ_IMM64
+
+// Helpers for compiled code take immediate arguments as a parameter
+#define CORE_READ_IMM8(data) (*(data) = (uint8_t)imm, 0)
+#define CORE_READ_IMM16(data) (*(data) = (uint16_t)imm, 0)
+#define CORE_READ_IMM32(data) (*(data) = (uint32_t)imm, 0)
+#define CORE_READ_IMM64(data) (*(data) = imm, 0)
+
+// Define a helper function for each opcode
+#define CORE_OP(op) \
+static int core_jit_##op(struct core *core, struct mem *mem, uint64_t imm) \
+{ \
+	int ret = 0; \
+	__attribute__((unused)) uint8_t temp_u8, temp_u8b; \
+	__attribute__((unused)) uint16_t temp_u16, temp_u16b; \
+	__attribute__((unused)) uint32_t temp_u32, temp_u32b; \
+	__attribute__((unused)) uint64_t temp_u64, temp_u64b; \
+	(void)core; \
+	(void)mem; \
+	(void)imm; \
+	do {
+#define CORE_OP_END } while (0); \
+	return ret; \
+}
+#include "core_ops.ct"
+#undef CORE_OP
+#undef CORE_OP_END
+
+static int core_jit_default(struct core *core, struct mem *mem, uint64_t imm)
+{
+	(void)core;
+	(void)mem;
+	(void)imm;
+	return STINT_INVALID_INST;
+}
+
+// Helper functions indexed by opcode
+static jit_helper_t const core_jit_helpers[256] = {
+#define CORE_HANDLER(op) core_jit_##op
+#define CORE_HANDLER_DEFAULT core_jit_default
+#include "core_handlers.ct"
+#undef CORE_HANDLER
+#undef CORE_HANDLER_DEFAULT
+};
+
+// Executes count decoded instructions with their individual helpers
+static int core_jit_components(struct core *core, struct mem *mem, const struct dinst *di,
+	int count, uint64_t *executed)
+{
+	int ret = 0;
+	for (int i = 0; i < count; i++) {
+		ret = core_jit_helpers[di[i].opcode](core, mem, di[i].imm);
+		(*executed)++;
+		if (ret || mem_code_gen(mem) != core->bcache.code_gen) break;
+	}
+	return ret;
+}
+
+// Define a helper function for each fused sequence. The stack must not overlap
+// IO memory for the fused handler to be used.
+#define CORE_FUSE(fuse, n) \
+static int core_jit_##fuse(struct core *core, struct mem *mem, const struct dinst *fdi, \
+	uint64_t *executed) \
+{ \
+	int ret = 0; \
+	__attribute__((unused)) uint8_t temp_u8, temp_u8b; \
+	__attribute__((unused)) uint16_t temp_u16, temp_u16b; \
+	__attribute__((unused)) uint32_t temp_u32, temp_u32b; \
+	__attribute__((unused)) uint64_t temp_u64, temp_u64b; \
+	if (core->sbp < END_IO_ADDR) { \
+		return core_jit_components(core, mem, fdi, n, executed); \
+	} \
+	core->bcache.fuse_counts[fuse]++; \
+	do {
+#define CORE_FUSE_NEXT() do { \
+	(*executed)++; \
+	if (mem_code_gen(mem) != core->bcache.code_gen) return 0; \
+} while (0)
+#define CORE_FUSE_IMM(i) fdi[i].imm
+#define CORE_FUSE_LEN(i) fdi[i].len
+#define CORE_FUSE_OPCODE(i) fdi[i].opcode
+#define CORE_OP_END } while (0); \
+	(*executed)++; \
+	return ret; \
+}
+#include "core_fused.ct"
+#undef CORE_FUSE
+#undef CORE_FUSE_NEXT
+#undef CORE_FUSE_IMM
+#undef CORE_FUSE_LEN
+#undef CORE_FUSE_OPCODE
+#undef CORE_OP_END
+
+// Fused helper functions indexed by fused sequence
+static jit_fused_helper_t const core_jit_fused_helpers[FUSE_COUNT] = {
+	[FUSE_PUSHI_LOADPOPSFP8] = core_jit_FUSE_PUSHI_LOADPOPSFP8,
+	[FUSE_PUSHI_LOADPOPSFP16] = core_jit_FUSE_PUSHI_LOADPOPSFP16,
+	[FUSE_PUSHI_LOADPOPSFP32] = core_jit_FUSE_PUSHI_LOADPOPSFP32,
+	[FUSE_PUSHI_LOADPOPSFP64] = core_jit_FUSE_PUSHI_LOADPOPSFP64,
+	[FUSE_PUSHI_ADD64] = core_jit_FUSE_PUSHI_ADD64,
+	[FUSE_PUSHI_SUB64] = core_jit_FUSE_PUSHI_SUB64,
+	[FUSE_CMP_BRZ64] = core_jit_FUSE_CMP_BRZ64,
+	[FUSE_DUP_PUSHI_CMP_BRZ64] = core_jit_FUSE_DUP_PUSHI_CMP_BRZ64,
+	[FUSE_DUP_PUSHSFP_CMP_BRZ64] = core_jit_FUSE_DUP_PUSHSFP_CMP_BRZ64,
+};
+
+#undef CORE_READ_IMM8
+#undef CORE_READ_IMM16
+#undef CORE_READ_IMM32
+#undef CORE_READ_IMM64
+
+// Immediate arguments are taken from the decoded instruction
+#define CORE_READ_IMM8(data) (*(data) = (uint8_t)di->imm, 0)
+#define CORE_READ_IMM16(data) (*(data) = (uint16_t)di->imm, 0)
+#define CORE_READ_IMM32(data) (*(data) = (uint32_t)di->imm, 0)
+#define CORE_READ_IMM64(data) (*(data) = di->imm, 0)
+
+// Returns the cached block at PC following the completion of the given block,
+// using its successor links or the shadow return address stack.
+// Returns NULL if the block must be looked up, in which case *link, if not
+// NULL, is set to where the looked up block should be linked.
+static struct block *core_chain(struct core *core, struct mem *mem, struct block *prev,
+	struct block ***link)
+{
+	struct bcache *bc = &core->bcache;
+	*link = NULL;
+	if (mem_code_gen(mem) != bc->code_gen) return NULL; // Cache is about to be flushed
+
+	struct core_ras_entry *entry;
+	struct block *caller;
+	switch (prev->insts[prev->count - 1].opcode) {
+	case op_call:
+	case op_calls:
+		// Predict a return to the instruction following the call
+		entry = core->ras + (core->ras_top++ & (CORE_RAS_SIZE - 1));
+		entry->reta = prev->end;
+		entry->block = prev;
+		entry->flushes = bc->flushes;
+		break;
+
+	case op_ret:
+		// Validate the prediction against the RETA the return actually used
+		entry = core->ras + (--core->ras_top & (CORE_RAS_SIZE - 1));
+		caller = entry->block;
+		entry->block = NULL;
+		if (caller && entry->flushes == bc->flushes && entry->reta == core->pc) {
+			bc->ret_hits++;
+			if (caller->ret_link) return caller->ret_link;
+			*link = &caller->ret_link;
+		}
+		else {
+			bc->ret_misses++;
+		}
+		return NULL;
+	}
+
+	for (int i = 0; i < BCACHE_NUM_LINKS; i++) {
+		if (prev->links[i] && prev->links[i]->addr == core->pc) {
+			bc->link_hits++;
+			return prev->links[i];
+		}
+	}
+	// Replace the least recently added link
+	memmove(prev->links + 1, prev->links, (BCACHE_NUM_LINKS - 1) * sizeof(struct block*));
+	prev->links[0] = NULL;
+	*link = prev->links;
+	return NULL;
+}
+
+int core_run_block(struct core *core, struct mem *mem, uint64_t *budget,
+	const struct bpfilter *stop)
+{
+	// Handler addresses indexed by opcode
+	static void *const handlers[256] = {
+#define CORE_HANDLER(op) &&l_##op
+#define CORE_HANDLER_DEFAULT &&l_default
+#include "core_handlers.ct"
+#undef CORE_HANDLER
+#undef CORE_HANDLER_DEFAULT
+	};
+
+	// Handler addresses indexed by fused sequence
+	static void *const fused_handlers[FUSE_COUNT] = {
+		[FUSE_NONE] = &&l_default,
+		[FUSE_PUSHI_LOADPOPSFP8] = &&l_FUSE_PUSHI_LOADPOPSFP8,
+		[FUSE_PUSHI_LOADPOPSFP16] = &&l_FUSE_PUSHI_LOADPOPSFP16,
+		[FUSE_PUSHI_LOADPOPSFP32] = &&l_FUSE_PUSHI_LOADPOPSFP32,
+		[FUSE_PUSHI_LOADPOPSFP64] = &&l_FUSE_PUSHI_LOADPOPSFP64,
+		[FUSE_PUSHI_ADD64] = &&l_FUSE_PUSHI_ADD64,
+		[FUSE_PUSHI_SUB64] = &&l_FUSE_PUSHI_SUB64,
+		[FUSE_CMP_BRZ64] = &&l_FUSE_CMP_BRZ64,
+		[FUSE_DUP_PUSHI_CMP_BRZ64] = &&l_FUSE_DUP_PUSHI_CMP_BRZ64,
+		[FUSE_DUP_PUSHSFP_CMP_BRZ64] = &&l_FUSE_DUP_PUSHSFP_CMP_BRZ64,
+	};
+
+	uint64_t count = *budget;
+	const struct dinst *di, *di_end;
+	const struct dinst *fdi; // First instruction of a fused sequence
+	struct block *block, *prev, **link;
+	uint64_t executed, flushes;
+	int ret = 0;
+
+	// Temporary variables for use by instructions
+	uint8_t temp_u8, temp_u8b;
+	uint16_t temp_u16, temp_u16b;
+	uint32_t temp_u32, temp_u32b;
+	uint64_t temp_u64, temp_u64b;
+
+	// Find the block at PC and dispatch to the handler of its first instruction
+l_lookup:
+	prev = NULL;
+
+	// As above, following prev, the block just completed
+l_next:
+	if (count == 0) goto l_exit;
+	ret = 0;
+	if (stop && bpfilter_test(stop, core->pc)) goto l_exit;
+	block = NULL;
+	link = NULL;
+	if (prev) block = core_chain(core, mem, prev, &link);
+	if (!block) {
+		flushes = core->bcache.flushes;
+		block = bcache_get(&core->bcache, mem, core->pc, handlers, fused_handlers);
+		if (link && block && core->bcache.flushes == flushes) *link = block;
+	}
+	// Instructions do not cross pages, and blocks are shorter than a page, so
+	// only the page of the last byte of the block remains to be checked
+	if (stop && block && bpfilter_test(stop, block->end - 1)) goto l_exit;
+	if (!block) {
+		// No decodable instruction at PC. Execute a single instruction instead.
+		ret = core_step(core, mem);
+		count--;
+		if (ret >= 0 && ret < 256) goto l_lookup; // Interrupts are already vectored
+		goto l_exit;
+	}
+	if (core->jit_threshold && count >= (uint64_t)block->count) {
+		if (!block->native && ++block->hits >= core->jit_threshold) {
+			// Block is hot. Compile it.
+			block->native = jit_compile(&core->bcache.jit, block, core->bcache.code_gen,
+				core_jit_helpers, core_jit_fused_helpers);
+			if (block->native) {
+				core->bcache.jit_blocks++;
+			}
+			else if (core->bcache.jit.used) {
+				// Arena may be full. Start over with an empty cache.
+				bcache_flush(&core->bcache);
+				goto l_lookup;
+			}
+			else {
+				// Compilation is not possible on this host
+				core->jit_threshold = 0;
+			}
+		}
+		if (block->native) {
+			ret = block->native(core, mem, &executed);
+			count -= executed;
+			if (ret) goto l_done;
+			prev = executed == (uint64_t)block->count ? block : NULL;
+			goto l_next;
+		}
+	}
+	di = block->insts;
+	di_end = di + (count < (uint64_t)block->count ? (int)count : block->count);
+	goto *di->handler;
+
+	// Each handler dispatches the next instruction in the block itself. The block
+	// is left early if memory it was decoded from has been modified.
+#define CORE_OP(op) l_##op: do {
+#define CORE_OP_END } while (0); \
+	count--; \
+	if (ret) goto l_done; \
+	if (++di == di_end) { \
+		prev = block; \
+		goto l_next; \
+	} \
+	if (mem_code_gen(mem) != core->bcache.code_gen) goto l_lookup; \
+	goto *di->handler;
+#include "core_ops.ct"
+#undef CORE_OP
+
+	// A fused sequence is executed by its component handlers when the block or
+	// budget ends within it, or the stack may overlap IO memory
+#define CORE_FUSE(fuse, n) l_##fuse: \
+	if (di_end - di < (n) || core->sbp < END_IO_ADDR) goto *handlers[di->opcode]; \
+	core->bcache.fuse_counts[fuse]++; \
+	fdi = di; \
+	do {
+#define CORE_FUSE_NEXT() do { \
+	di++; \
+	count--; \
+	if (mem_code_gen(mem) != core->bcache.code_gen) goto l_lookup; \
+} while (0)
+#define CORE_FUSE_IMM(i) fdi[i].imm
+#define CORE_FUSE_LEN(i) fdi[i].len
+#define CORE_FUSE_OPCODE(i) fdi[i].opcode
+#include "core_fused.ct"
+#undef CORE_FUSE
+#undef CORE_FUSE_NEXT
+#undef CORE_FUSE_IMM
+#undef CORE_FUSE_LEN
+#undef CORE_FUSE_OPCODE
+#undef CORE_OP_END
+
+l_default: // Unassigned opcodes are never decoded
+	ret = STINT_INVALID_INST;
+	count--;
+
+	// The last instruction raised an interrupt, halted, or failed
+l_done:
+	if (ret > 0 && ret < 256) {
+		// An interrupt occurred. Vector to interrupt handler.
+		core->pc = BEGIN_INT_ADDR + 16 * ret;
+		goto l_lookup;
+	}
+
+l_exit:
+	*budget = count;
+	return ret;
+}
+
+#undef CORE_READ_IMM8
+#undef CORE_READ_IMM16
+#undef CORE_READ_IMM32
+#undef CORE_READ_IMM64
+
+// Executes up to *budget instructions with core_step, with the same semantics as
+// core_run_threaded
+static int core_run_switch(struct core *core, struct mem *mem, uint64_t *budget,
+	const struct bpfilter *stop)
+{
+	int ret = 0;
+	for (; *budget; ) {
+		if (stop && bpfilter_test(stop, core->pc)) break;
+		ret = core_step(core, mem);
+		--*budget;
+		if (ret < 0 || ret >= 256) break;
+	}
+	return ret;
+}
+
+// Returns whether pc is at a breakpoint. Only addresses on pages flagged in the
+// page filter are looked up in the BP map.
+static inline int core_at_breakpoint(const struct core *core)
+{
+	int count;
+	return bpfilter_test(core->bpfilter, core->pc) && bpmap_get(core->bpmap, core->pc, &count);
+}
+
+// Maximum number of instructions run by an engine per call from core_run
+enum { CORE_RUN_BATCH_SIZE = 0x10000 };
+
+// Executes up to *budget instructions on the configured engine, as core_run_threaded
+static inline int core_run_engine(struct core *core, struct mem *mem, uint64_t *budget,
+	const struct bpfilter *stop)
+{
+	switch (core->engine) {
+	case CORE_ENGINE_THREADED:
+		return core_run_threaded(core, mem, budget, stop);
+	case CORE_ENGINE_BLOCK:
+	case CORE_ENGINE_JIT:
+		return core_run_block(core, mem, budget, stop);
+	default:
+		return core_run_switch(core, mem, budget, stop);
+	}
+}
+
+// Define a core_run variant for each combination of options
+#define CORE_RUN_NAME core_run_plain
+#define CORE_RUN_BP 0
+#define CORE_RUN_LIMIT 0
+#define CORE_RUN_STEP 0
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_b
+#define CORE_RUN_BP 1
+#define CORE_RUN_LIMIT 0
+#define CORE_RUN_STEP 0
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_c
+#define CORE_RUN_BP 0
+#define CORE_RUN_LIMIT 1
+#define CORE_RUN_STEP 0
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_bc
+#define CORE_RUN_BP 1
+#define CORE_RUN_LIMIT 1
+#define CORE_RUN_STEP 0
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_m
+#define CORE_RUN_BP 0
+#define CORE_RUN_LIMIT 0
+#define CORE_RUN_STEP 1
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_bm
+#define CORE_RUN_BP 1
+#define CORE_RUN_LIMIT 0
+#define CORE_RUN_STEP 1
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_cm
+#define CORE_RUN_BP 0
+#define CORE_RUN_LIMIT 1
+#define CORE_RUN_STEP 1
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+#define CORE_RUN_NAME core_run_bcm
+#define CORE_RUN_BP 1
+#define CORE_RUN_LIMIT 1
+#define CORE_RUN_STEP 1
+#include "core_run.ct"
+#undef CORE_RUN_NAME
+#undef CORE_RUN_BP
+#undef CORE_RUN_LIMIT
+#undef CORE_RUN_STEP
+
+int core_wait_start(struct core *core, struct mem *mem)
+{
+	if (!core->waiting) return 0;
+	if (!__atomic_load_n(&core->start.ready, __ATOMIC_ACQUIRE)) return 1;
+	core->pc = core->start.pc;
+	core->sbp = core->sfp = core->sp = core->start.sbp;
+	core->slp = core->start.slp;
+	core_stack_pin(core, mem);
+	core->waiting = 0;
+	return 0;
+}
+
+int core_run(struct core *core, struct mem *mem, uint64_t *budget, int *stop_reason)
+{
+	// Variants indexed by CORE_RUN_* flags
+	static int (*const variants[8])(struct core*, struct mem*, uint64_t*, int*) = {
+		core_run_plain,
+		core_run_b,
+		core_run_c,
+		core_run_bc,
+		core_run_m,
+		core_run_bm,
+		core_run_cm,
+		core_run_bcm,
+	};
+	return variants[core->run_opts & 7](core, mem, budget, stop_reason);
+}
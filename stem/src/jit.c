@@ -0,0 +1,705 @@
+// jit.c
+//
+// Compiles predecoded blocks to x86-64 code. Common 64 bit stack operations are
+// compiled to native code, which keeps SP in a register and accesses the pinned
+// stack region directly after checking its bounds inline. When a check fails,
+// the instruction is executed out of line by its helper, which raises the same
+// interrupt as the interpreter. Other instructions call their helper, and mem
+// code_gen is checked only after those which may store.
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "bcache.h"
+#include "core.h"
+#include "jit.h"
+#include "starch.h"
+
+void jit_init(struct jit *jit)
+{
+	memset(jit, 0, sizeof(struct jit));
+}
+
+void jit_destroy(struct jit *jit)
+{
+	if (jit->arena) {
+		munmap(jit->arena, JIT_ARENA_SIZE);
+		jit->arena = NULL;
+	}
+	jit->used = 0;
+}
+
+void jit_flush(struct jit *jit)
+{
+	jit->used = 0;
+}
+
+#if defined(__x86_64__)
+
+enum {
+	JIT_SHARED_SIZE = 256,
+	JIT_PROLOGUE_SIZE = 24,
+	JIT_INST_MAX_SIZE = 256, // Including the out of line path
+	JIT_END_SIZE = 48,
+	JIT_MAX_CHECKS = 4, // Maximum number of inline checks of a native instruction
+};
+
+// Registers
+enum {
+	X86_RAX, X86_RCX, X86_RDX, X86_RBX, X86_RSP, X86_RBP, X86_RSI, X86_RDI,
+	X86_R8, X86_R9, X86_R10, X86_R11, X86_R12, X86_R13, X86_R14, X86_R15,
+};
+
+// Registers held by compiled code. R10, R11, R14 and R15 are loaded by the
+// reload routine on entry and after each helper call.
+enum {
+	JIT_CORE = X86_RBX,     // struct core*
+	JIT_MEM = X86_R12,      // struct mem*
+	JIT_EXECUTED = X86_R13, // uint64_t *executed
+	JIT_LO = X86_R10,       // Lowest frame address, max(SFP, SBP)
+	JIT_HI = X86_R11,       // SLP
+	JIT_SP = X86_R14,       // SP
+	JIT_BIAS = X86_R15,     // Host address of guest address 0 in the pinned stack region
+};
+
+// Condition codes
+enum {
+	X86_CC_B = 0x2, X86_CC_AE = 0x3, X86_CC_E = 0x4, X86_CC_NE = 0x5,
+	X86_CC_BE = 0x6, X86_CC_A = 0x7, X86_CC_L = 0xc, X86_CC_GE = 0xd,
+	X86_CC_LE = 0xe, X86_CC_G = 0xf,
+};
+
+// Out of line path of a native instruction, taken when an inline check fails
+struct jit_slow {
+	const struct dinst *di;
+	int index; // Index of the instruction in the block
+	uint64_t pc; // Address of the instruction
+	uint8_t *resume; // Where to continue after the helper, or NULL for the end of the block
+};
+
+// State of the compilation of a block
+struct jit_state {
+	uint8_t *pos; // Next byte to emit
+	const struct jit *jit;
+	struct jit_slow slow[BCACHE_MAX_INSTS];
+	int slow_count;
+	uint8_t *fixups[BCACHE_MAX_INSTS * JIT_MAX_CHECKS]; // Displacements of jumps to slow paths
+	int fixup_slow[BCACHE_MAX_INSTS * JIT_MAX_CHECKS]; // Slow path index of each jump
+	int fixup_count;
+	uint8_t *end_fixups[2]; // Displacements of jumps to the end of the block
+	int end_fixup_count;
+};
+
+static void emit(uint8_t **pos, const void *bytes, size_t size)
+{
+	memcpy(*pos, bytes, size);
+	*pos += size;
+}
+
+static void emit8(uint8_t **pos, uint8_t val)
+{
+	emit(pos, &val, sizeof(val));
+}
+
+static void emit32(uint8_t **pos, uint32_t val)
+{
+	emit(pos, &val, sizeof(val));
+}
+
+static void emit64(uint8_t **pos, uint64_t val)
+{
+	emit(pos, &val, sizeof(val));
+}
+
+// Emits a 32 bit displacement relative to the end of the displacement
+static void emit_rel32(uint8_t **pos, const uint8_t *target)
+{
+	emit32(pos, (uint32_t)(target - (*pos + 4)));
+}
+
+// Points the 32 bit displacement at rel to target
+static void patch_rel32(uint8_t *rel, const uint8_t *target)
+{
+	uint32_t val = (uint32_t)(target - (rel + 4));
+	memcpy(rel, &val, sizeof(val));
+}
+
+// Points the 8 bit displacement at rel to target, which must be within range
+static void patch_rel8(uint8_t *rel, const uint8_t *target)
+{
+	*rel = (uint8_t)(target - (rel + 1));
+}
+
+// Emits a 64 bit instruction with register operand reg, or an opcode extension,
+// and register operand rm
+static void emit_rr(uint8_t **pos, const char *opcode, int reg, int rm)
+{
+	emit8(pos, 0x48 | (reg & 8) >> 1 | (rm & 8) >> 3);
+	emit(pos, opcode, strlen(opcode));
+	emit8(pos, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// Emits a 64 bit instruction with register operand reg, or an opcode extension,
+// and memory operand [base + index + disp], or [base + disp] if index is negative
+static void emit_mem(uint8_t **pos, const char *opcode, int reg, int base, int index, int32_t disp)
+{
+	emit8(pos, 0x48 | (reg & 8) >> 1 | (index >= 0 ? (index & 8) >> 2 : 0) | (base & 8) >> 3);
+	emit(pos, opcode, strlen(opcode));
+	int mod = disp == 0 && (base & 7) != X86_RBP ? 0 : disp == (int8_t)disp ? 1 : 2;
+	if (index >= 0 || (base & 7) == X86_RSP) {
+		emit8(pos, mod << 6 | (reg & 7) << 3 | X86_RSP);
+		emit8(pos, (index >= 0 ? index & 7 : X86_RSP) << 3 | (base & 7));
+	}
+	else {
+		emit8(pos, mod << 6 | (reg & 7) << 3 | (base & 7));
+	}
+	if (mod == 1) {
+		emit8(pos, (uint8_t)disp);
+	}
+	else if (mod == 2) {
+		emit32(pos, (uint32_t)disp);
+	}
+}
+
+// Emits an instruction accessing the given field of the core
+static void emit_core(uint8_t **pos, const char *opcode, int reg, size_t offset)
+{
+	emit_mem(pos, opcode, reg, JIT_CORE, -1, (int32_t)offset);
+}
+
+// Emits an instruction accessing the stack at SP + disp
+static void emit_stack(uint8_t **pos, const char *opcode, int reg, int32_t disp)
+{
+	emit_mem(pos, opcode, reg, JIT_BIAS, JIT_SP, disp);
+}
+
+// Emits a 64 bit add of a sign-extended 8 bit immediate to a register
+static void emit_add_imm8(uint8_t **pos, int rm, int8_t imm)
+{
+	emit_rr(pos, "\x83", 0, rm);
+	emit8(pos, (uint8_t)imm);
+}
+
+// Emits a conditional jump with a 32 bit displacement to be patched, returning
+// the address of the displacement
+static uint8_t *emit_jcc32(uint8_t **pos, int cc)
+{
+	emit8(pos, 0x0f);
+	emit8(pos, 0x80 | cc);
+	uint8_t *rel = *pos;
+	emit32(pos, 0);
+	return rel;
+}
+
+// Emits a conditional jump with an 8 bit displacement to be patched, returning
+// the address of the displacement
+static uint8_t *emit_jcc8(uint8_t **pos, int cc)
+{
+	emit8(pos, 0x70 | cc);
+	uint8_t *rel = *pos;
+	emit8(pos, 0);
+	return rel;
+}
+
+// Emits a store of the given value to the given field of the core
+static void emit_store_core(uint8_t **pos, size_t offset, uint64_t val)
+{
+	if ((int64_t)val == (int32_t)val) {
+		emit_core(pos, "\xc7", 0, offset); // mov qword [core + offset], imm32
+		emit32(pos, (uint32_t)val);
+	}
+	else {
+		emit(pos, "\x48\xb8", 2); // mov rax, imm64
+		emit64(pos, val);
+		emit_core(pos, "\x89", X86_RAX, offset);
+	}
+}
+
+// Emits a store of SP and the given PC to the core
+static void emit_sync(uint8_t **pos, uint64_t pc)
+{
+	emit_core(pos, "\x89", JIT_SP, offsetof(struct core, sp));
+	emit_store_core(pos, offsetof(struct core, pc), pc);
+}
+
+// Emits an exit from the block with *executed = executed and the return value in eax
+static void emit_exit(struct jit_state *st, int executed)
+{
+	emit_mem(&st->pos, "\xc7", 0, JIT_EXECUTED, -1, 0); // mov qword [executed], imm32
+	emit32(&st->pos, executed);
+	emit(&st->pos, "\xe9", 1); // jmp exit
+	emit_rel32(&st->pos, st->jit->exit);
+}
+
+// Emits the routines shared by all blocks
+static void emit_shared(struct jit *jit, uint8_t **pos)
+{
+	// Restores callee-saved registers and returns from the block
+	jit->exit = *pos;
+	emit(pos, "\x41\x5f", 2); // pop r15
+	emit(pos, "\x41\x5e", 2); // pop r14
+	emit(pos, "\x41\x5d", 2); // pop r13
+	emit(pos, "\x41\x5c", 2); // pop r12
+	emit(pos, "\x5b", 1);     // pop rbx
+	emit(pos, "\xc3", 1);     // ret
+
+	// Loads the registers describing the stack from the core. If the stack region
+	// is not pinned, the bounds are set so that every inline frame check fails.
+	jit->reload = *pos;
+	emit_core(pos, "\x8b", JIT_SP, offsetof(struct core, sp));
+	emit_core(pos, "\x8b", JIT_LO, offsetof(struct core, sfp));
+	emit_core(pos, "\x8b", X86_RAX, offsetof(struct core, sbp));
+	emit_rr(pos, "\x39", X86_RAX, JIT_LO);     // cmp lo, rax
+	emit_rr(pos, "\x0f\x42", JIT_LO, X86_RAX); // cmovb lo, rax
+	emit_core(pos, "\x8b", JIT_HI, offsetof(struct core, slp));
+	emit_core(pos, "\x8b", JIT_BIAS, offsetof(struct core, stack_host));
+	emit_rr(pos, "\x85", JIT_BIAS, JIT_BIAS);  // test bias, bias
+	uint8_t *unpinned[5];
+	unpinned[0] = emit_jcc8(pos, X86_CC_E);
+	emit_core(pos, "\x8b", X86_RCX, offsetof(struct core, stack_gen));
+	emit_mem(pos, "\x3b", X86_RCX, JIT_MEM, -1, offsetof(struct mem, map_gen));
+	unpinned[1] = emit_jcc8(pos, X86_CC_NE);
+	emit_core(pos, "\x3b", X86_RAX, offsetof(struct core, stack_addr));
+	unpinned[2] = emit_jcc8(pos, X86_CC_NE);
+	emit_core(pos, "\x3b", JIT_HI, offsetof(struct core, stack_end));
+	unpinned[3] = emit_jcc8(pos, X86_CC_NE);
+	emit_rr(pos, "\x39", JIT_HI, JIT_LO);      // cmp lo, hi
+	unpinned[4] = emit_jcc8(pos, X86_CC_A);
+	emit_rr(pos, "\x29", X86_RAX, JIT_BIAS);   // sub bias, rax
+	emit(pos, "\xc3", 1);                      // ret
+	for (int i = 0; i < 5; i++) {
+		patch_rel8(unpinned[i], *pos);
+	}
+	// lo + below and hi - above cannot overflow, and no SP is in between
+	emit_rr(pos, "\xc7", 0, JIT_LO);
+	emit32(pos, (uint32_t)-33);
+	emit_rr(pos, "\xc7", 0, JIT_HI);
+	emit32(pos, 16);
+	emit(pos, "\xc3", 1); // ret
+}
+
+// Begins the out of line path of the native instruction being compiled
+static void add_slow(struct jit_state *st, const struct dinst *di, int index, uint64_t pc)
+{
+	struct jit_slow *slow = st->slow + st->slow_count++;
+	slow->di = di;
+	slow->index = index;
+	slow->pc = pc;
+	slow->resume = NULL;
+}
+
+// Emits a conditional jump to the out of line path of the current instruction
+static void emit_jcc_slow(struct jit_state *st, int cc)
+{
+	st->fixups[st->fixup_count] = emit_jcc32(&st->pos, cc);
+	st->fixup_slow[st->fixup_count] = st->slow_count - 1;
+	st->fixup_count++;
+}
+
+// Emits a jump to the end of the block
+static void emit_jmp_end(struct jit_state *st)
+{
+	emit(&st->pos, "\xe9", 1);
+	st->end_fixups[st->end_fixup_count++] = st->pos;
+	emit32(&st->pos, 0);
+}
+
+// Emits the checks that [SP - below, SP + above) is within the frame, as in
+// core_frame_fits, using two of the inline checks of the instruction
+static void emit_frame_check(struct jit_state *st, int8_t below, int8_t above)
+{
+	if (below) {
+		emit_mem(&st->pos, "\x8d", X86_RAX, JIT_LO, -1, below); // lea rax, [lo + below]
+		emit_rr(&st->pos, "\x39", X86_RAX, JIT_SP);             // cmp sp, rax
+	}
+	else {
+		emit_rr(&st->pos, "\x39", JIT_LO, JIT_SP);              // cmp sp, lo
+	}
+	emit_jcc_slow(st, X86_CC_B);
+	if (above) {
+		emit_mem(&st->pos, "\x8d", X86_RCX, JIT_HI, -1, -above); // lea rcx, [hi - above]
+		emit_rr(&st->pos, "\x39", X86_RCX, JIT_SP);              // cmp sp, rcx
+	}
+	else {
+		emit_rr(&st->pos, "\x39", JIT_HI, JIT_SP);               // cmp sp, hi
+	}
+	emit_jcc_slow(st, X86_CC_A);
+}
+
+// Emits the computation into rax of the stack address of the signed SFP offset at
+// SP + disp, as in CORE_GEN_SFP_ADDR, and the checks that 64 bits at the address
+// are within the stack, using two of the inline checks of the instruction
+static void emit_sfp_addr(struct jit_state *st, int32_t disp)
+{
+	emit_stack(&st->pos, "\x8b", X86_RAX, disp);
+	emit_mem(&st->pos, "\x8d", X86_RCX, X86_RAX, -1, -STACK_FRAME_METADATA_SIZE); // lea rcx, [rax - size]
+	emit_rr(&st->pos, "\x85", X86_RAX, X86_RAX);     // test rax, rax
+	emit_rr(&st->pos, "\x0f\x48", X86_RAX, X86_RCX); // cmovs rax, rcx
+	emit_core(&st->pos, "\x03", X86_RAX, offsetof(struct core, sfp));
+	emit_core(&st->pos, "\x3b", X86_RAX, offsetof(struct core, sbp));
+	emit_jcc_slow(st, X86_CC_B);
+	emit_mem(&st->pos, "\x8d", X86_RCX, JIT_HI, -1, -8); // lea rcx, [hi - 8]
+	emit_rr(&st->pos, "\x39", X86_RCX, X86_RAX);         // cmp rax, rcx
+	emit_jcc_slow(st, X86_CC_A);
+}
+
+// Returns the condition under which the given 64 bit comparison opcode is
+// true, or -1 if the opcode is not a 64 bit comparison
+static int cmp64_cc(int opcode)
+{
+	switch (opcode) {
+	case op_ceq64: return X86_CC_E;
+	case op_cne64: return X86_CC_NE;
+	case op_cgtu64: return X86_CC_A;
+	case op_cgti64: return X86_CC_G;
+	case op_cltu64: return X86_CC_B;
+	case op_clti64: return X86_CC_L;
+	case op_cgeu64: return X86_CC_AE;
+	case op_cgei64: return X86_CC_GE;
+	case op_cleu64: return X86_CC_BE;
+	case op_clei64: return X86_CC_LE;
+	}
+	return -1;
+}
+
+// Returns the opcode of the x86 instruction combining a register into memory
+// for the given 64 bit binary opcode, or NULL if there is none
+static const char *binary64_opcode(int opcode)
+{
+	switch (opcode) {
+	case op_add64: return "\x01";
+	case op_sub64: return "\x29";
+	case op_band64: return "\x21";
+	case op_bor64: return "\x09";
+	case op_bxor64: return "\x31";
+	}
+	return NULL;
+}
+
+// Returns whether the given opcode is compiled to native code when it is the
+// instruction at index of a block of count instructions
+static int is_native(int opcode, int index, int count)
+{
+	switch (opcode) {
+	case op_push8asu64:
+	case op_push8asi64:
+	case op_push16asu64:
+	case op_push16asi64:
+	case op_push32asu64:
+	case op_push32asi64:
+	case op_push64as64:
+	case op_pop64:
+	case op_dup64:
+	case op_loadpopsfp64:
+	case op_storepopsfp64:
+	case op_storerpopsfp64:
+		return 1;
+	case op_rjmpi8:
+	case op_rjmpi16:
+	case op_rjmpi32:
+	case op_rbrz64i8:
+	case op_rbrz64i16:
+	case op_rbrz64i32:
+		// Control leaves the block
+		return index == count - 1;
+	}
+	return binary64_opcode(opcode) != NULL || cmp64_cc(opcode) >= 0;
+}
+
+// Returns whether the helper for the given opcode may modify memory
+static int may_store(int opcode)
+{
+	return opcode == op_ext || (flags_for_opcode(opcode) & (STOPF_FRAME | STOPF_SFP | STOPF_MEM));
+}
+
+// Emits native code for the instruction at index, at address pc. Returns whether
+// the instruction ends the block.
+static int emit_native(struct jit_state *st, const struct dinst *di, int index, uint64_t pc)
+{
+	uint8_t **pos = &st->pos;
+	const char *binary = binary64_opcode(di->opcode);
+	int cc = cmp64_cc(di->opcode);
+
+	add_slow(st, di, index, pc);
+	switch (di->opcode) {
+	case op_push8asu64:
+	case op_push8asi64:
+	case op_push16asu64:
+	case op_push16asi64:
+	case op_push32asu64:
+	case op_push32asi64:
+	case op_push64as64:
+		emit_frame_check(st, 0, 8);
+		if ((int64_t)di->imm == (int32_t)di->imm) {
+			emit_stack(pos, "\xc7", 0, 0); // mov qword [sp], imm32
+			emit32(pos, (uint32_t)di->imm);
+		}
+		else {
+			emit(pos, "\x48\xb8", 2); // mov rax, imm64
+			emit64(pos, di->imm);
+			emit_stack(pos, "\x89", X86_RAX, 0);
+		}
+		emit_add_imm8(pos, JIT_SP, 8);
+		break;
+	case op_pop64:
+		emit_add_imm8(pos, JIT_SP, -8);
+		break;
+	case op_dup64:
+		emit_frame_check(st, 8, 8);
+		emit_stack(pos, "\x8b", X86_RAX, -8);
+		emit_stack(pos, "\x89", X86_RAX, 0);
+		emit_add_imm8(pos, JIT_SP, 8);
+		break;
+	case op_loadpopsfp64:
+		emit_frame_check(st, 8, 0);
+		emit_sfp_addr(st, -8);
+		emit_mem(pos, "\x8b", X86_RAX, JIT_BIAS, X86_RAX, 0); // mov rax, [bias + rax]
+		emit_stack(pos, "\x89", X86_RAX, -8);
+		break;
+	case op_storepopsfp64:
+	case op_storerpopsfp64:
+		emit_frame_check(st, 16, 0);
+		emit_sfp_addr(st, di->opcode == op_storepopsfp64 ? -16 : -8);
+		emit_stack(pos, "\x8b", X86_RCX, di->opcode == op_storepopsfp64 ? -8 : -16);
+		emit_mem(pos, "\x89", X86_RCX, JIT_BIAS, X86_RAX, 0); // mov [bias + rax], rcx
+		emit_add_imm8(pos, JIT_SP, -8);
+		break;
+	case op_rjmpi8:
+	case op_rjmpi16:
+	case op_rjmpi32:
+		emit_sync(pos, pc + di->imm);
+		emit_jmp_end(st);
+		return 1;
+	case op_rbrz64i8:
+	case op_rbrz64i16:
+	case op_rbrz64i32: {
+		emit_frame_check(st, 8, 0);
+		emit_stack(pos, "\x8b", X86_RAX, -8);
+		emit_add_imm8(pos, JIT_SP, -8);
+		emit_rr(pos, "\x85", X86_RAX, X86_RAX); // test rax, rax
+		uint8_t *not_taken = emit_jcc8(pos, X86_CC_NE);
+		emit_sync(pos, pc + di->imm);
+		emit_jmp_end(st);
+		patch_rel8(not_taken, *pos);
+		emit_sync(pos, pc + di->len);
+		emit_jmp_end(st);
+		return 1;
+	}
+	default:
+		if (binary) {
+			emit_frame_check(st, 16, 0);
+			emit_stack(pos, "\x8b", X86_RAX, -8);
+			emit_stack(pos, binary, X86_RAX, -16);
+		}
+		else {
+			emit_frame_check(st, 16, 0);
+			emit_stack(pos, "\x8b", X86_RAX, -16);
+			emit_stack(pos, "\x3b", X86_RAX, -8); // cmp rax, [sp - 8]
+			emit8(pos, 0x0f);
+			emit8(pos, 0x90 | cc);
+			emit8(pos, 0xc0);                     // setcc al
+			emit(pos, "\x0f\xb6\xc0", 3);         // movzx eax, al
+			emit_stack(pos, "\x89", X86_RAX, -16);
+		}
+		emit_add_imm8(pos, JIT_SP, -8);
+		break;
+	}
+	st->slow[st->slow_count - 1].resume = *pos;
+	return 0;
+}
+
+// Emits a call to the helper for the instruction at index, and an exit if it
+// returns nonzero or modifies code, after which the stack registers are reloaded
+static void emit_helper(struct jit_state *st, const struct dinst *di, int index, uint64_t code_gen,
+	jit_helper_t const helpers[256])
+{
+	uint8_t **pos = &st->pos;
+
+	// eax = helper(core, mem, imm)
+	emit(pos, "\x48\x89\xdf", 3); // mov rdi, rbx
+	emit(pos, "\x4c\x89\xe6", 3); // mov rsi, r12
+	if (di->imm == 0) {
+		emit(pos, "\x31\xd2", 2); // xor edx, edx
+	}
+	else {
+		emit(pos, "\x48\xba", 2); // mov rdx, imm64
+		emit64(pos, di->imm);
+	}
+	emit(pos, "\x48\xb8", 2); // mov rax, imm64
+	emit64(pos, (uint64_t)(uintptr_t)helpers[di->opcode]);
+	emit(pos, "\xff\xd0", 2); // call rax
+
+	// Exit if the instruction raised an interrupt, halted, or failed
+	emit(pos, "\x85\xc0", 2); // test eax, eax
+	uint8_t *ok = emit_jcc8(pos, X86_CC_E);
+	emit_exit(st, index + 1);
+	patch_rel8(ok, *pos);
+
+	// Exit if code in memory was modified
+	if (may_store(di->opcode)) {
+		emit(pos, "\x48\xb9", 2); // mov rcx, imm64
+		emit64(pos, code_gen);
+		emit_mem(pos, "\x39", X86_RCX, JIT_MEM, -1, offsetof(struct mem, code_gen));
+		ok = emit_jcc8(pos, X86_CC_E);
+		emit_exit(st, index + 1);
+		patch_rel8(ok, *pos);
+	}
+
+	emit(pos, "\xe8", 1); // call reload
+	emit_rel32(pos, st->jit->reload);
+}
+
+jit_entry_t jit_compile(struct jit *jit, const struct block *block, uint64_t code_gen,
+	jit_helper_t const helpers[256], jit_fused_helper_t const fused_helpers[])
+{
+	if (jit->arena == NULL) {
+		void *arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (arena == MAP_FAILED) return NULL;
+		jit->arena = (uint8_t*)arena;
+	}
+
+	size_t max_size = JIT_SHARED_SIZE + JIT_PROLOGUE_SIZE +
+		block->count * JIT_INST_MAX_SIZE + JIT_END_SIZE;
+	if (JIT_ARENA_SIZE - jit->used < max_size) return NULL;
+
+	// Make the arena writable only while emitting code
+	if (mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE)) return NULL;
+
+	struct jit_state state;
+	struct jit_state *st = &state;
+	st->pos = jit->arena + jit->used;
+	st->jit = jit;
+	st->slow_count = 0;
+	st->fixup_count = 0;
+	st->end_fixup_count = 0;
+	uint8_t **pos = &st->pos;
+
+	if (jit->used == 0) {
+		emit_shared(jit, pos);
+	}
+
+	// Save callee-saved registers, which also aligns the stack for calls
+	uint8_t *entry = *pos;
+	emit(pos, "\x53", 1);         // push rbx
+	emit(pos, "\x41\x54", 2);     // push r12
+	emit(pos, "\x41\x55", 2);     // push r13
+	emit(pos, "\x41\x56", 2);     // push r14
+	emit(pos, "\x41\x57", 2);     // push r15
+	emit(pos, "\x48\x89\xfb", 3); // mov rbx, rdi (core)
+	emit(pos, "\x49\x89\xf4", 3); // mov r12, rsi (mem)
+	emit(pos, "\x49\x89\xd5", 3); // mov r13, rdx (executed)
+	emit(pos, "\xe8", 1);         // call reload
+	emit_rel32(pos, jit->reload);
+
+	// Whether the SP and PC of the core are up to date
+	int synced = 1;
+	int ended = 0;
+	uint64_t pc = block->addr;
+	for (int i = 0; i < block->count && !ended;) {
+		const struct dinst *di = block->insts + i;
+
+		// A fused sequence is compiled as its components if they are all native
+		int n = di->fuse != FUSE_NONE ? fuse_len(di->fuse) : 1;
+		int native = 1;
+		for (int j = 0; j < n; j++) {
+			native = native && is_native(di[j].opcode, i + j, block->count);
+		}
+
+		if (native) {
+			ended = emit_native(st, di, i, pc);
+			synced = 0;
+			pc += di->len;
+			i++;
+			continue;
+		}
+
+		if (!synced) {
+			emit_sync(pos, pc);
+			synced = 1;
+		}
+		if (di->fuse != FUSE_NONE) {
+			// *executed = i
+			emit_mem(pos, "\xc7", 0, JIT_EXECUTED, -1, 0); // mov qword [r13], imm32
+			emit32(pos, i);
+
+			// eax = fused_helper(core, mem, di, executed)
+			emit(pos, "\x48\x89\xdf", 3); // mov rdi, rbx
+			emit(pos, "\x4c\x89\xe6", 3); // mov rsi, r12
+			emit(pos, "\x48\xba", 2);     // mov rdx, imm64
+			emit64(pos, (uint64_t)(uintptr_t)di);
+			emit(pos, "\x4c\x89\xe9", 3); // mov rcx, r13
+			emit(pos, "\x48\xb8", 2);     // mov rax, imm64
+			emit64(pos, (uint64_t)(uintptr_t)fused_helpers[di->fuse]);
+			emit(pos, "\xff\xd0", 2);     // call rax
+
+			// Exit if the sequence returned nonzero or modified code, having set *executed
+			emit(pos, "\x85\xc0", 2); // test eax, eax
+			emit(pos, "\x0f\x85", 2); // jnz exit
+			emit_rel32(pos, jit->exit);
+			emit(pos, "\x48\xb9", 2); // mov rcx, imm64
+			emit64(pos, code_gen);
+			emit_mem(pos, "\x39", X86_RCX, JIT_MEM, -1, offsetof(struct mem, code_gen));
+			emit(pos, "\x0f\x85", 2); // jne exit
+			emit_rel32(pos, jit->exit);
+			emit(pos, "\xe8", 1);     // call reload
+			emit_rel32(pos, jit->reload);
+		}
+		else {
+			emit_helper(st, di, i, code_gen, helpers);
+		}
+		for (int j = 0; j < n; j++) {
+			pc += di[j].len;
+		}
+		i += n;
+	}
+	if (!ended && !synced) {
+		emit_sync(pos, pc);
+	}
+
+	// The block completed with SP and PC stored
+	uint8_t *end = *pos;
+	for (int i = 0; i < st->end_fixup_count; i++) {
+		patch_rel32(st->end_fixups[i], end);
+	}
+	emit(pos, "\x31\xc0", 2); // xor eax, eax
+	emit_exit(st, block->count);
+
+	// Out of line paths run the helper, which repeats the checks exactly
+	for (int i = 0; i < st->slow_count; i++) {
+		const struct jit_slow *slow = st->slow + i;
+		int checks = 0;
+		for (int j = 0; j < st->fixup_count; j++) {
+			if (st->fixup_slow[j] == i) {
+				patch_rel32(st->fixups[j], *pos);
+				checks++;
+			}
+		}
+		if (!checks) continue;
+		emit_sync(pos, slow->pc);
+		emit_helper(st, slow->di, slow->index, code_gen, helpers);
+		emit(pos, "\xe9", 1); // jmp resume
+		emit_rel32(pos, slow->resume ? slow->resume : end);
+	}
+
+	jit->used = *pos - jit->arena;
+	if (mprotect(jit->arena, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC)) return NULL;
+	return (jit_entry_t)(void*)entry;
+}
+
+#else
+
+jit_entry_t jit_compile(struct jit *jit, const struct block *block, uint64_t code_gen,
+	jit_helper_t const helpers[256], jit_fused_helper_t const fused_helpers[])
+{
+	// Unsupported host
+	(void)jit;
+	(void)block;
+	(void)code_gen;
+	(void)helpers;
+	(void)fused_helpers;
+	return NULL;
+}
+
+#endif
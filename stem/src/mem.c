@@ -4,32 +4,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "mem.h"
 #include "starch.h"
 #include "util.h"
 
-enum {
-	MEM_PAGE_SIZE = 0x1000,
-	MEM_PAGE_MASK = (MEM_PAGE_SIZE - 1),
-};
-
 //
-// Memory node
+// Memory node. Holds the data of one page. Used as a tree node by the tree
+// backend, and referenced from the last level of tables by the radix backend.
 //
 struct mem_node {
 	struct mem_node *prev, *next;
 	uint64_t addr; // Start address
 	uint8_t depth; // Max following generations
-	uint8_t data[MEM_PAGE_SIZE]; // Page data
+	uint8_t code; // Whether the page holds decoded code
+	// Page data, aligned so that aligned guest words are aligned on the host for
+	// atomic operations
+	_Alignas(8) uint8_t data[MEM_PAGE_SIZE];
 };
 
+// Data of pages which have never been written
+static const uint8_t mem_zero_page[MEM_PAGE_SIZE];
+
+// Locks the page index if the memory is shared
+static inline void mem_lock(const struct mem *mem)
+{
+	if (mem->shared) pthread_mutex_lock((pthread_mutex_t*)&mem->lock);
+}
+
+static inline void mem_unlock(const struct mem *mem)
+{
+	if (mem->shared) pthread_mutex_unlock((pthread_mutex_t*)&mem->lock);
+}
+
 static void mem_node_init(struct mem_node *node, uint64_t addr)
 {
 	memset(node, 0, sizeof(struct mem_node));
 	node->addr = addr;
 }
 
+// Allocates a new memory node for the page containing the given address
+static struct mem_node *mem_node_alloc(struct mem *mem, uint64_t addr)
+{
+	struct mem_node *node = (struct mem_node*)malloc(sizeof(struct mem_node));
+	mem_node_init(node, addr & ~MEM_PAGE_MASK);
+	mem->node_count++;
+	if (mem->zero_mapped) {
+		// Pointers to the zero page may have been given for this page
+		mem->zero_mapped = 0;
+		__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+	}
+	return node;
+}
+
 static void mem_node_destroy(struct mem_node *node)
 {
 	if (node->prev) {
@@ -129,10 +157,7 @@ static struct mem_node *mem_node_get_page(struct mem *mem, struct mem_node *node
 {
 	struct mem_node *retnode;
 	if (!node) {
-		// Allocate a new memory node for the page
-		retnode = (struct mem_node*)malloc(sizeof(struct mem_node));
-		mem_node_init(retnode, addr & ~MEM_PAGE_MASK);
-		mem->node_count++;
+		retnode = mem_node_alloc(mem, addr);
 	}
 	else if (addr < node->addr) {
 		retnode = mem_node_get_page(mem, node->prev, addr);
@@ -198,13 +223,131 @@ static int mem_node_iterate(struct mem_node *node, struct iter_params *params)
 	return ret;
 }
 
+//
+// Radix table
+//
+
+// Frees the given table at the given level and everything it references.
+// Level zero tables reference memory nodes.
+static void mem_radix_destroy(void **table, int level)
+{
+	for (int i = 0; i < MEM_RADIX_FANOUT; i++) {
+		if (!table[i]) continue;
+		if (level) {
+			mem_radix_destroy((void**)table[i], level - 1);
+		}
+		else {
+			free(table[i]);
+		}
+	}
+	free(table);
+}
+
+static struct mem_node *mem_radix_get_page(struct mem *mem, uint64_t addr)
+{
+	uint64_t pn = addr / MEM_PAGE_SIZE;
+	void **table = mem->radix;
+	for (int level = mem->radix_levels - 1; level > 0; level--) {
+		void **slot = table + ((pn >> (level * MEM_RADIX_BITS)) & (MEM_RADIX_FANOUT - 1));
+		if (!*slot) {
+			*slot = calloc(MEM_RADIX_FANOUT, sizeof(void*));
+		}
+		table = (void**)*slot;
+	}
+	struct mem_node **leaf = (struct mem_node**)table + (pn & (MEM_RADIX_FANOUT - 1));
+	if (!*leaf) {
+		*leaf = mem_node_alloc(mem, addr);
+	}
+	return *leaf;
+}
+
+// Returns the node for the page containing the given address, or NULL if the
+// page has not been allocated
+static struct mem_node *mem_radix_find_page(const struct mem *mem, uint64_t addr)
+{
+	uint64_t pn = addr / MEM_PAGE_SIZE;
+	void **table = mem->radix;
+	for (int level = mem->radix_levels - 1; table && level > 0; level--) {
+		table = (void**)table[(pn >> (level * MEM_RADIX_BITS)) & (MEM_RADIX_FANOUT - 1)];
+	}
+	return table ? (struct mem_node*)table[pn & (MEM_RADIX_FANOUT - 1)] : NULL;
+}
+
+// Calls the iteration function on the nodes in the given table at the given
+// level, in address order, which are in the range given by the parameters.
+// base is the first page number covered by the table.
+static int mem_radix_iterate(void **table, int level, uint64_t base, struct iter_params *params)
+{
+	int ret = 0;
+	const uint64_t span = (uint64_t)1 << (level * MEM_RADIX_BITS); // Pages per slot
+	for (int i = 0; ret == 0 && i < MEM_RADIX_FANOUT; i++) {
+		if (!table[i]) continue;
+		uint64_t begin = (base + i * span) * MEM_PAGE_SIZE;
+		if (params->end_addr != 0 && begin >= params->end_addr) break;
+		if (begin + span * MEM_PAGE_SIZE <= params->begin_addr) continue;
+		if (level) {
+			ret = mem_radix_iterate((void**)table[i], level - 1, base + i * span, params);
+		}
+		else {
+			ret = params->iter_func((struct mem_node*)table[i], params);
+		}
+	}
+	return ret;
+}
+
 //
 // Memory object
 //
-void mem_init(struct mem *mem, uint64_t size)
+// Returns the number of pages needed to hold the memory
+static uint64_t mem_page_count(const struct mem *mem)
+{
+	return mem->size / MEM_PAGE_SIZE + ((mem->size & MEM_PAGE_MASK) != 0);
+}
+
+int mem_init(struct mem *mem, uint64_t size, int backend)
 {
 	memset(mem, 0, sizeof(struct mem));
 	mem->size = size;
+	mem->backend = backend;
+	if (backend == MEM_BACKEND_FLAT) {
+		// Reserve address space only. The host provides zero pages on first touch.
+		uint64_t npages = mem_page_count(mem);
+		void *flat = mmap(NULL, npages * MEM_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (flat == MAP_FAILED) {
+			return 1;
+		}
+		void *flat_pages = mmap(NULL, npages, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (flat_pages == MAP_FAILED) {
+			munmap(flat, npages * MEM_PAGE_SIZE);
+			return 1;
+		}
+		mem->flat = (uint8_t*)flat;
+		mem->flat_pages = (uint8_t*)flat_pages;
+	}
+	else if (backend == MEM_BACKEND_RADIX) {
+		// Use enough levels to index every page below size
+		uint64_t max_pn = size ? (size - 1) / MEM_PAGE_SIZE : 0;
+		mem->radix_levels = 1;
+		while (max_pn >> (mem->radix_levels * MEM_RADIX_BITS)) {
+			mem->radix_levels++;
+		}
+		mem->radix = (void**)calloc(MEM_RADIX_FANOUT, sizeof(void*));
+	}
+	return 0;
+}
+
+int mem_share(struct mem *mem)
+{
+	if (mem->shared) {
+		return 0;
+	}
+	if (pthread_mutex_init(&mem->lock, NULL)) {
+		return 1;
+	}
+	mem->shared = 1;
+	return 0;
 }
 
 void mem_destroy(struct mem *mem)
@@ -212,12 +355,69 @@ void mem_destroy(struct mem *mem)
 	if (mem->root) {
 		mem_node_destroy(mem->root);
 		mem->root = NULL;
-		mem->node_count = 0;
 	}
+	if (mem->radix) {
+		mem_radix_destroy(mem->radix, mem->radix_levels - 1);
+		mem->radix = NULL;
+	}
+	if (mem->flat) {
+		uint64_t npages = mem_page_count(mem);
+		munmap(mem->flat, npages * MEM_PAGE_SIZE);
+		munmap(mem->flat_pages, npages);
+		mem->flat = NULL;
+		mem->flat_pages = NULL;
+	}
+	for (int i = 0; i < mem->pin_count; i++) {
+		free(mem->pins[i].data);
+		free(mem->pins[i].code);
+	}
+	mem->pin_count = 0;
+	for (int i = 0; i < mem->retired_count; i++) {
+		free(mem->retired[i]);
+	}
+	free(mem->retired);
+	mem->retired = NULL;
+	mem->retired_count = 0;
+	mem->node_count = 0;
+	if (mem->shared) {
+		pthread_mutex_destroy(&mem->lock);
+		mem->shared = 0;
+	}
+}
+
+// Returns the pinned region containing the given address, or NULL if none
+static struct mem_pin *mem_find_pin(const struct mem *mem, uint64_t addr)
+{
+	for (int i = 0; i < mem->pin_count; i++) {
+		if (addr >= mem->pins[i].addr && addr < mem->pins[i].end) {
+			return (struct mem_pin*)mem->pins + i;
+		}
+	}
+	return NULL;
 }
 
+// Returns the node for the page containing the given address, or NULL if the
+// page has not been allocated. Does not modify the index.
+static struct mem_node *mem_find_page(const struct mem *mem, uint64_t addr)
+{
+	if (mem->backend == MEM_BACKEND_RADIX) {
+		return mem_radix_find_page(mem, addr);
+	}
+
+	struct mem_node *node = mem->root;
+	while (node && (addr < node->addr || addr >= node->addr + MEM_PAGE_SIZE)) {
+		node = addr < node->addr ? node->prev : node->next;
+	}
+	return node;
+}
+
+// Returns the node for the page containing the given address, allocating it if needed
 static struct mem_node *mem_get_page(struct mem *mem, uint64_t addr)
 {
+	if (mem->backend == MEM_BACKEND_RADIX) {
+		return mem_radix_get_page(mem, addr);
+	}
+
 	struct mem_node *page = mem_node_get_page(mem, mem->root, addr);
 	if (mem->root == NULL) {
 		mem->root = page;
@@ -228,61 +428,149 @@ static struct mem_node *mem_get_page(struct mem *mem, uint64_t addr)
 	return page;
 }
 
-int mem_write8(struct mem *mem, uint64_t addr, uint8_t data)
+// Notes a modification of the given page, invalidating any code decoded from it
+static void mem_node_modify(struct mem *mem, struct mem_node *node)
 {
-	return mem_write(mem, addr, 1, &data);
+	if (node->code) {
+		node->code = 0;
+		__atomic_fetch_add(&mem->code_gen, 1, __ATOMIC_RELAXED);
+	}
 }
 
-int mem_write16(struct mem *mem, uint64_t addr, uint16_t data)
+// Returns the data of the page containing the given address for reading, which
+// is the zero page if the page has not been allocated. The caller holds the lock.
+static const uint8_t *mem_find_data_locked(const struct mem *mem, uint64_t addr)
 {
-	uint8_t buf[2];
-	put_little16(data, buf);
-	return mem_write(mem, addr, 2, buf);
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		return mem->flat + (addr & ~(uint64_t)MEM_PAGE_MASK);
+	}
+	if (mem->pin_count) {
+		struct mem_pin *pin = mem_find_pin(mem, addr);
+		if (pin) return pin->data + ((addr & ~(uint64_t)MEM_PAGE_MASK) - pin->addr);
+	}
+	struct mem_node *node = mem_find_page(mem, addr);
+	return node ? node->data : mem_zero_page;
 }
 
-int mem_write32(struct mem *mem, uint64_t addr, uint32_t data)
+// Sets the MEM_FLAT_* flags of the given page number of flat memory. The caller
+// holds the lock.
+static void mem_flat_set_flags(struct mem *mem, uint64_t page, uint8_t flags)
 {
-	uint8_t buf[4];
-	put_little32(data, buf);
-	return mem_write(mem, addr, 4, buf);
+	__atomic_store_n(mem->flat_pages + page, flags, __ATOMIC_RELEASE);
 }
 
-int mem_write64(struct mem *mem, uint64_t addr, uint64_t data)
+// Returns the data of the page containing the given address for writing, which
+// must be less than the memory size. The page is noted as modified. The caller
+// holds the lock.
+static uint8_t *mem_get_data_locked(struct mem *mem, uint64_t addr)
 {
-	uint8_t buf[8];
-	put_little64(data, buf);
-	return mem_write(mem, addr, 8, buf);
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		uint64_t page = addr / MEM_PAGE_SIZE;
+		if (mem_flat_flags(mem, page) & MEM_FLAT_CODE) {
+			__atomic_fetch_add(&mem->code_gen, 1, __ATOMIC_RELAXED);
+		}
+		mem_flat_set_flags(mem, page, MEM_FLAT_WRITTEN);
+		return mem->flat + (addr & ~(uint64_t)MEM_PAGE_MASK);
+	}
+	if (mem->pin_count) {
+		struct mem_pin *pin = mem_find_pin(mem, addr);
+		if (pin) {
+			uint64_t offset = (addr & ~(uint64_t)MEM_PAGE_MASK) - pin->addr;
+			uint8_t *code = pin->code + offset / MEM_PAGE_SIZE;
+			if (*code) {
+				*code = 0;
+				__atomic_fetch_add(&mem->code_gen, 1, __ATOMIC_RELAXED);
+			}
+			return pin->data + offset;
+		}
+	}
+
+	struct mem_node *node = mem_get_page(mem, addr);
+	mem_node_modify(mem, node);
+	return node->data;
 }
 
-int mem_read8(struct mem *mem, uint64_t addr, uint8_t *data)
+// Returns the data of the page containing the given address for reading
+static const uint8_t *mem_find_data(const struct mem *mem, uint64_t addr)
 {
-	return mem_read(mem, addr, 1, data);
+	mem_lock(mem);
+	const uint8_t *data = mem_find_data_locked(mem, addr);
+	mem_unlock(mem);
+	return data;
 }
 
-int mem_read16(struct mem *mem, uint64_t addr, uint16_t *data)
+// Returns the data of the page containing the given address for writing
+static uint8_t *mem_get_data(struct mem *mem, uint64_t addr)
 {
-	uint8_t buf[2];
-	int ret = mem_read(mem, addr, 2, buf);
-	if (ret == 0) *data = get_little16(buf);
-	return ret;
+	mem_lock(mem);
+	uint8_t *data = mem_get_data_locked(mem, addr);
+	mem_unlock(mem);
+	return data;
 }
 
-int mem_read32(struct mem *mem, uint64_t addr, uint32_t *data)
+// Marks the page containing the given address as code. The caller holds the lock.
+static int mem_mark_code_locked(struct mem *mem, uint64_t addr)
 {
-	uint8_t buf[4];
-	int ret = mem_read(mem, addr, 4, buf);
-	if (ret == 0) *data = get_little32(buf);
-	return ret;
+	if (addr >= mem->size) {
+		return 1;
+	}
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		uint64_t page = addr / MEM_PAGE_SIZE;
+		uint8_t flags = mem_flat_flags(mem, page);
+		if (!(flags & MEM_FLAT_CODE)) {
+			mem_flat_set_flags(mem, page, flags | MEM_FLAT_CODE);
+			__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+		}
+		return 0;
+	}
+	struct mem_pin *pin = mem_find_pin(mem, addr);
+	if (pin) {
+		uint8_t *code = pin->code + (addr - pin->addr) / MEM_PAGE_SIZE;
+		if (!*code) {
+			*code = 1;
+			__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+		}
+		return 0;
+	}
+	struct mem_node *node = mem_get_page(mem, addr);
+	if (!node->code) {
+		// Direct writes to the page must now be noted
+		node->code = 1;
+		__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+	}
+	return 0;
 }
 
-int mem_read64(struct mem *mem, uint64_t addr, uint64_t *data)
+int mem_mark_code(struct mem *mem, uint64_t addr)
 {
-	uint8_t buf[8];
-	int ret = mem_read(mem, addr, 8, buf);
-	if (ret == 0) *data = get_little64(buf);
+	mem_lock(mem);
+	int ret = mem_mark_code_locked(mem, addr);
+	mem_unlock(mem);
+	// Order the map_gen increment before reads of the code. A thread which wrote
+	// the page through a pointer translated before the mark then either has its
+	// write read, or sees the increment after the write and notes it.
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 	return ret;
 }
 
+uint8_t *mem_page_data(struct mem *mem, uint64_t addr, int write)
+{
+	addr &= ~(uint64_t)MEM_PAGE_MASK;
+	if (addr >= mem->size || mem->size - addr < MEM_PAGE_SIZE) {
+		return NULL;
+	}
+	if (write) {
+		return mem_get_data(mem, addr);
+	}
+	mem_lock(mem);
+	const uint8_t *data = mem_find_data_locked(mem, addr);
+	if (data == mem_zero_page) {
+		mem->zero_mapped = 1;
+	}
+	mem_unlock(mem);
+	return (uint8_t*)data; // Only written through if write was nonzero
+}
+
 int mem_load_image(struct mem *mem, uint64_t addr, uint64_t size, FILE *image_file)
 {
 	const uint64_t end_addr = addr + size;
@@ -297,8 +585,8 @@ int mem_load_image(struct mem *mem, uint64_t addr, uint64_t size, FILE *image_fi
 		if (max_read > end_addr - addr) {
 			max_read = end_addr - addr;
 		}
-		struct mem_node *node = mem_get_page(mem, addr);
-		size_t num_read = fread(node->data + (addr & MEM_PAGE_MASK), 1, max_read, image_file);
+		uint8_t *page = mem_get_data(mem, addr);
+		size_t num_read = fread(page + (addr & MEM_PAGE_MASK), 1, max_read, image_file);
 		if (num_read != max_read) {
 			ret = 1;
 			break;
@@ -321,8 +609,8 @@ int mem_write(struct mem *mem, uint64_t addr, uint64_t size, const uint8_t *data
 		if (max_copy > end_addr - addr) {
 			max_copy = end_addr - addr;
 		}
-		struct mem_node *node = mem_get_page(mem, addr);
-		memcpy(node->data + (addr & MEM_PAGE_MASK), data, max_copy);
+		uint8_t *page = mem_get_data(mem, addr);
+		memcpy(page + (addr & MEM_PAGE_MASK), data, max_copy);
 		data += max_copy;
 		addr += max_copy;
 	}
@@ -342,25 +630,412 @@ int mem_read(struct mem *mem, uint64_t addr, uint64_t size, uint8_t *data)
 		if (max_copy > end_addr - addr) {
 			max_copy = end_addr - addr;
 		}
-		struct mem_node *node = mem_get_page(mem, addr);
-		memcpy(data, node->data + (addr & MEM_PAGE_MASK), max_copy);
+		const uint8_t *page = mem_find_data(mem, addr);
+		memcpy(data, page + (addr & MEM_PAGE_MASK), max_copy);
 		data += max_copy;
 		addr += max_copy;
 	}
 	return 0;
 }
 
-static int print_hex_iter_func(struct mem_node *node, struct iter_params *params)
+// Returns whether an access of size bytes at addr is within memory and does not
+// cross a page boundary, so that it may be made directly on the page data
+static inline int mem_in_page(const struct mem *mem, uint64_t addr, uint64_t size)
 {
-	FILE *hex_file = (FILE*)params->user_ptr;
+	return (addr & MEM_PAGE_MASK) <= MEM_PAGE_SIZE - size &&
+		addr < mem->size && mem->size - addr >= size;
+}
 
-	uint64_t addr = node->addr;
+int mem_write8(struct mem *mem, uint64_t addr, uint8_t data)
+{
+	if (addr >= mem->size) {
+		return 1;
+	}
+	mem_get_data(mem, addr)[addr & MEM_PAGE_MASK] = data;
+	return 0;
+}
+
+int mem_write16(struct mem *mem, uint64_t addr, uint16_t data)
+{
+	if (mem_in_page(mem, addr, 2)) {
+		put_little16(data, mem_get_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[2];
+	put_little16(data, buf);
+	return mem_write(mem, addr, 2, buf);
+}
+
+int mem_write32(struct mem *mem, uint64_t addr, uint32_t data)
+{
+	if (mem_in_page(mem, addr, 4)) {
+		put_little32(data, mem_get_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[4];
+	put_little32(data, buf);
+	return mem_write(mem, addr, 4, buf);
+}
+
+int mem_write64(struct mem *mem, uint64_t addr, uint64_t data)
+{
+	if (mem_in_page(mem, addr, 8)) {
+		put_little64(data, mem_get_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[8];
+	put_little64(data, buf);
+	return mem_write(mem, addr, 8, buf);
+}
+
+int mem_read8(struct mem *mem, uint64_t addr, uint8_t *data)
+{
+	if (addr >= mem->size) {
+		return 1;
+	}
+	*data = mem_find_data(mem, addr)[addr & MEM_PAGE_MASK];
+	return 0;
+}
+
+int mem_read16(struct mem *mem, uint64_t addr, uint16_t *data)
+{
+	if (mem_in_page(mem, addr, 2)) {
+		*data = get_little16(mem_find_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[2];
+	int ret = mem_read(mem, addr, 2, buf);
+	if (ret == 0) *data = get_little16(buf);
+	return ret;
+}
+
+int mem_read32(struct mem *mem, uint64_t addr, uint32_t *data)
+{
+	if (mem_in_page(mem, addr, 4)) {
+		*data = get_little32(mem_find_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[4];
+	int ret = mem_read(mem, addr, 4, buf);
+	if (ret == 0) *data = get_little32(buf);
+	return ret;
+}
+
+int mem_read64(struct mem *mem, uint64_t addr, uint64_t *data)
+{
+	if (mem_in_page(mem, addr, 8)) {
+		*data = get_little64(mem_find_data(mem, addr) + (addr & MEM_PAGE_MASK));
+		return 0;
+	}
+	uint8_t buf[8];
+	int ret = mem_read(mem, addr, 8, buf);
+	if (ret == 0) *data = get_little64(buf);
+	return ret;
+}
+
+// Returns whether the given page data is all zero
+static int mem_data_is_zero(const uint8_t *data)
+{
+	return memcmp(data, mem_zero_page, MEM_PAGE_SIZE) == 0;
+}
+
+// Appends the nodes of the given tree in address order to the given array
+static void mem_node_collect(struct mem_node *node, struct mem_node **nodes, uint64_t *count)
+{
+	if (!node) return;
+	mem_node_collect(node->prev, nodes, count);
+	nodes[(*count)++] = node;
+	mem_node_collect(node->next, nodes, count);
+}
+
+// Builds a balanced tree from the given nodes in address order, returning the root
+static struct mem_node *mem_node_build(struct mem_node **nodes, uint64_t count)
+{
+	if (count == 0) return NULL;
+	uint64_t mid = count / 2;
+	struct mem_node *node = nodes[mid];
+	node->prev = mem_node_build(nodes, mid);
+	node->next = mem_node_build(nodes + mid + 1, count - mid - 1);
+	mem_node_update_depth(node);
+	return node;
+}
+
+// Frees reclaimable nodes in the given radix table at the given level, and
+// tables below it which become empty. Returns whether the table is now empty.
+static int mem_radix_reclaim(void **table, int level, uint64_t *freed)
+{
+	int empty = 1;
+	for (int i = 0; i < MEM_RADIX_FANOUT; i++) {
+		if (!table[i]) continue;
+		if (level) {
+			if (mem_radix_reclaim((void**)table[i], level - 1, freed)) {
+				free(table[i]);
+				table[i] = NULL;
+				continue;
+			}
+		}
+		else {
+			struct mem_node *node = (struct mem_node*)table[i];
+			if (!node->code && mem_data_is_zero(node->data)) {
+				free(node);
+				table[i] = NULL;
+				(*freed)++;
+				continue;
+			}
+		}
+		empty = 0;
+	}
+	return empty;
+}
+
+uint64_t mem_reclaim(struct mem *mem)
+{
+	uint64_t freed = 0;
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		// Return zero pages to the host
+		uint64_t npages = mem_page_count(mem);
+		for (uint64_t page = 0; page < npages; page++) {
+			uint8_t *data = mem->flat + page * MEM_PAGE_SIZE;
+			if (mem_flat_flags(mem, page) == MEM_FLAT_WRITTEN && mem_data_is_zero(data)) {
+				madvise(data, MEM_PAGE_SIZE, MADV_DONTNEED);
+				mem_flat_set_flags(mem, page, 0);
+				freed++;
+			}
+		}
+	}
+	else if (mem->backend == MEM_BACKEND_RADIX) {
+		mem_radix_reclaim(mem->radix, mem->radix_levels - 1, &freed);
+		mem->node_count -= freed;
+	}
+	else if (mem->node_count) {
+		// Free zero nodes and rebuild the tree from the rest
+		struct mem_node **nodes = (struct mem_node**)malloc(sizeof(struct mem_node*) * mem->node_count);
+		uint64_t count = 0, kept = 0;
+		mem_node_collect(mem->root, nodes, &count);
+		for (uint64_t i = 0; i < count; i++) {
+			if (!nodes[i]->code && mem_data_is_zero(nodes[i]->data)) {
+				free(nodes[i]);
+				freed++;
+			}
+			else {
+				nodes[kept++] = nodes[i];
+			}
+		}
+		mem->root = mem_node_build(nodes, kept);
+		mem->node_count = kept;
+		free(nodes);
+	}
+
+	if (freed) {
+		// Pointers to freed pages are no longer valid
+		__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+	}
+	return freed;
+}
+
+// Frees the index nodes of pages in the given page-aligned range
+static void mem_remove_range(struct mem *mem, uint64_t addr, uint64_t end)
+{
+	if (mem->backend == MEM_BACKEND_RADIX) {
+		for (uint64_t pn = addr / MEM_PAGE_SIZE; pn < end / MEM_PAGE_SIZE; pn++) {
+			void **table = mem->radix;
+			for (int level = mem->radix_levels - 1; table && level > 0; level--) {
+				table = (void**)table[(pn >> (level * MEM_RADIX_BITS)) & (MEM_RADIX_FANOUT - 1)];
+			}
+			if (table && table[pn & (MEM_RADIX_FANOUT - 1)]) {
+				free(table[pn & (MEM_RADIX_FANOUT - 1)]);
+				table[pn & (MEM_RADIX_FANOUT - 1)] = NULL;
+				mem->node_count--;
+			}
+		}
+	}
+	else if (mem->node_count) {
+		// Rebuild the tree without the nodes in the range
+		struct mem_node **nodes = (struct mem_node**)malloc(sizeof(struct mem_node*) * mem->node_count);
+		uint64_t count = 0, kept = 0;
+		mem_node_collect(mem->root, nodes, &count);
+		for (uint64_t i = 0; i < count; i++) {
+			if (nodes[i]->addr >= addr && nodes[i]->addr < end) {
+				free(nodes[i]);
+			}
+			else {
+				nodes[kept++] = nodes[i];
+			}
+		}
+		mem->root = mem_node_build(nodes, kept);
+		mem->node_count = kept;
+		free(nodes);
+	}
+}
+
+// Pins the pages [begin, end) as mem_pin. The caller holds the lock.
+static uint8_t *mem_pin_locked(struct mem *mem, uint64_t addr, uint64_t begin, uint64_t end)
+{
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		// Flat memory is already contiguous. Note the pages as written for dumps.
+		for (uint64_t pn = begin / MEM_PAGE_SIZE; pn < end / MEM_PAGE_SIZE; pn++) {
+			if (mem_flat_flags(mem, pn) & MEM_FLAT_CODE) return NULL;
+		}
+		for (uint64_t pn = begin / MEM_PAGE_SIZE; pn < end / MEM_PAGE_SIZE; pn++) {
+			mem_flat_set_flags(mem, pn, MEM_FLAT_WRITTEN);
+		}
+		return mem->flat + addr;
+	}
+
+	// Look for an existing or overlapping region
+	int index;
+	for (index = 0; index < mem->pin_count; index++) {
+		struct mem_pin *pin = mem->pins + index;
+		if (pin->addr == begin && pin->end == end) {
+			for (uint64_t i = 0; i < (end - begin) / MEM_PAGE_SIZE; i++) {
+				if (pin->code[i]) return NULL;
+			}
+			return pin->data + (addr - begin);
+		}
+		if (pin->addr < end && begin < pin->end) {
+			return NULL;
+		}
+		if (pin->addr > begin) break;
+	}
+	if (mem->pin_count == MEM_MAX_PINS) {
+		return NULL;
+	}
+
+	// Copy the pages of the region into a new buffer. Pinning is optional, so
+	// allocation failure leaves the pages in the index.
+	uint8_t *data = (uint8_t*)calloc(1, end - begin);
+	uint8_t *code = (uint8_t*)calloc(1, (end - begin) / MEM_PAGE_SIZE);
+	if (!data || !code) {
+		free(data);
+		free(code);
+		return NULL;
+	}
+	for (uint64_t page = begin; page < end; page += MEM_PAGE_SIZE) {
+		struct mem_node *node = mem_find_page(mem, page);
+		if (!node) continue;
+		// Other threads may hold pointers to pages of shared memory, so only
+		// ranges never written are pinned, in place
+		if (node->code || mem->shared) {
+			free(data);
+			free(code);
+			return NULL;
+		}
+		memcpy(data + (page - begin), node->data, MEM_PAGE_SIZE);
+	}
+	mem_remove_range(mem, begin, end);
+
+	// Insert the region in address order
+	memmove(mem->pins + index + 1, mem->pins + index, sizeof(struct mem_pin) * (mem->pin_count - index));
+	mem->pin_count++;
+	struct mem_pin *pin = mem->pins + index;
+	pin->addr = begin;
+	pin->end = end;
+	pin->data = data;
+	pin->code = code;
+
+	// Pointers to the removed pages are no longer valid
+	__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+	return data + (addr - begin);
+}
+
+uint8_t *mem_pin(struct mem *mem, uint64_t addr, uint64_t size)
+{
+	uint64_t begin = addr & ~(uint64_t)MEM_PAGE_MASK;
+	uint64_t end = (addr + size + MEM_PAGE_MASK) & ~(uint64_t)MEM_PAGE_MASK;
+	if (size == 0 || size > MEM_PIN_MAX_SIZE || end > mem->size || end <= begin) {
+		return NULL;
+	}
+	mem_lock(mem);
+	uint8_t *data = mem_pin_locked(mem, addr, begin, end);
+	mem_unlock(mem);
+	return data;
+}
+
+// Unpins the region containing addr as mem_unpin. The caller holds the lock.
+static void mem_unpin_locked(struct mem *mem, uint64_t addr)
+{
+	struct mem_pin *found = mem_find_pin(mem, addr);
+	if (!found) return;
+
+	// Remove the region before restoring its pages to the index
+	struct mem_pin pin = *found;
+	int index = found - mem->pins;
+	memmove(mem->pins + index, mem->pins + index + 1, sizeof(struct mem_pin) * (mem->pin_count - index - 1));
+	mem->pin_count--;
+
+	for (uint64_t page = pin.addr; page < pin.end; page += MEM_PAGE_SIZE) {
+		const uint8_t *data = pin.data + (page - pin.addr);
+		uint8_t code = pin.code[(page - pin.addr) / MEM_PAGE_SIZE];
+		if (!code && mem_data_is_zero(data)) continue;
+		struct mem_node *node = mem_get_page(mem, page);
+		memcpy(node->data, data, MEM_PAGE_SIZE);
+		node->code = code;
+	}
+	free(pin.code);
+	if (mem->shared) {
+		// Other threads may still write through pointers into the buffer
+		// until they see map_gen change, so keep it until mem_destroy. It is
+		// leaked rather than freed if it cannot be recorded.
+		uint8_t **retired = (uint8_t**)realloc(mem->retired, sizeof(uint8_t*) * (mem->retired_count + 1));
+		if (retired) {
+			retired[mem->retired_count++] = pin.data;
+			mem->retired = retired;
+		}
+	}
+	else {
+		free(pin.data);
+	}
+
+	// Pointers into the buffer are no longer valid
+	__atomic_fetch_add(&mem->map_gen, 1, __ATOMIC_RELAXED);
+}
+
+void mem_unpin(struct mem *mem, uint64_t addr)
+{
+	mem_lock(mem);
+	mem_unpin_locked(mem, addr);
+	mem_unlock(mem);
+}
+
+// State for hex dumps
+struct hex_params {
+	FILE *hex_file;
+	const struct mem *mem;
+	int next_pin; // Index of the next pinned region to print
+};
+
+static int print_hex_page(uint64_t page_addr, const uint8_t *data, struct iter_params *params);
+
+// Prints the pinned regions which begin before the given address and have not been printed
+static int print_hex_pins(uint64_t before, struct iter_params *params)
+{
+	struct hex_params *hp = (struct hex_params*)params->user_ptr;
+	int ret = 0;
+	for (; ret == 0 && hp->next_pin < hp->mem->pin_count; hp->next_pin++) {
+		const struct mem_pin *pin = hp->mem->pins + hp->next_pin;
+		if (pin->addr >= before) break;
+		for (uint64_t page = pin->addr; ret == 0 && page < pin->end; page += MEM_PAGE_SIZE) {
+			if (params->end_addr != 0 && page >= params->end_addr) break;
+			if (page + MEM_PAGE_SIZE <= params->begin_addr) continue;
+			ret = print_hex_page(page, pin->data + (page - pin->addr), params);
+		}
+	}
+	return ret;
+}
+
+// Prints the rows of the page at the given address with the given data which
+// are in the range given by the parameters
+static int print_hex_page(uint64_t page_addr, const uint8_t *data, struct iter_params *params)
+{
+	FILE *hex_file = ((struct hex_params*)params->user_ptr)->hex_file;
+
+	uint64_t addr = page_addr;
 	if (addr < params->begin_addr) {
 		addr = params->begin_addr;
 	}
 	addr &= ~(uint64_t)0xf;
 
-	uint64_t stop_addr = node->addr + MEM_PAGE_SIZE;
+	uint64_t stop_addr = page_addr + MEM_PAGE_SIZE;
 	if (params->end_addr != 0 && stop_addr > params->end_addr) {
 		stop_addr = params->end_addr;
 		stop_addr = (stop_addr + 15) & ~(uint64_t)0xf;
@@ -370,7 +1045,7 @@ static int print_hex_iter_func(struct mem_node *node, struct iter_params *params
 	for (; ret == 0 && addr < stop_addr; addr += 16) {
 		int i;
 		for (i = 0; i < 16; i++) {
-			if (node->data[(addr + i) & MEM_PAGE_MASK]) {
+			if (data[(addr + i) & MEM_PAGE_MASK]) {
 				break;
 			}
 		}
@@ -383,7 +1058,7 @@ static int print_hex_iter_func(struct mem_node *node, struct iter_params *params
 		if (ret < 0) break;
 		// Print row data
 		for (i = 0; i < 16; i++) {
-			ret = fprintf(hex_file, " %02x", node->data[(addr + i) & MEM_PAGE_MASK]);
+			ret = fprintf(hex_file, " %02x", data[(addr + i) & MEM_PAGE_MASK]);
 			if (ret < 0) break;
 		}
 		if (i == 16) {
@@ -394,12 +1069,45 @@ static int print_hex_iter_func(struct mem_node *node, struct iter_params *params
 	return ret;
 }
 
+static int print_hex_iter_func(struct mem_node *node, struct iter_params *params)
+{
+	int ret = print_hex_pins(node->addr, params);
+	if (ret) return ret;
+	return print_hex_page(node->addr, node->data, params);
+}
+
 int mem_dump_hex(struct mem *mem, uint64_t addr, uint64_t size, FILE *hex_file)
 {
 	struct iter_params params;
 	params.begin_addr = addr;
 	params.end_addr = addr + size;
 	params.iter_func = print_hex_iter_func;
-	params.user_ptr = hex_file;
-	return mem_node_iterate(mem->root, &params);
+	struct hex_params hp = { hex_file, mem, 0 };
+	params.user_ptr = &hp;
+	if (mem->backend == MEM_BACKEND_FLAT) {
+		// Print written pages in the range
+		int ret = 0;
+		uint64_t end_page = mem_page_count(mem);
+		if (size != 0 && (addr + size - 1) / MEM_PAGE_SIZE < end_page) {
+			end_page = (addr + size - 1) / MEM_PAGE_SIZE + 1;
+		}
+		for (uint64_t page = addr / MEM_PAGE_SIZE; ret == 0 && page < end_page; page++) {
+			if (mem_flat_flags(mem, page) & MEM_FLAT_WRITTEN) {
+				ret = print_hex_page(page * MEM_PAGE_SIZE, mem->flat + page * MEM_PAGE_SIZE, &params);
+			}
+		}
+		return ret;
+	}
+	int ret;
+	if (mem->backend == MEM_BACKEND_RADIX) {
+		ret = mem_radix_iterate(mem->radix, mem->radix_levels - 1, 0, &params);
+	}
+	else {
+		ret = mem_node_iterate(mem->root, &params);
+	}
+	if (ret == 0) {
+		// Print pinned regions after the last page in the index
+		ret = print_hex_pins(UINT64_MAX, &params);
+	}
+	return ret;
 }
@@ -63,6 +63,7 @@ static int do_break(size_t argc, const char *argv[], int *flags)
 
 	// Add new breakpoint
 	bpmap = bpmap_insert(bpmap, addr, 1);
+	bpfilter_build(&bpfilter, bpmap);
 	printf("breakpoint set at address %#"PRIx64"\n", addr);
 	return 0;
 }
@@ -93,6 +94,7 @@ static int do_delete(size_t argc, const char *argv[], int *flags)
 
 	// Remove the breakpoint
 	bpmap = bpmap_remove(bpmap, addr);
+	bpfilter_build(&bpfilter, bpmap);
 	return 0;
 }
 
@@ -133,6 +135,17 @@ static int do_quit(size_t argc, const char *argv[], int *flags)
 	return 0;
 }
 
+// Free memory pages which are all zero
+static int do_reclaim(size_t argc, const char *argv[], int *flags)
+{
+	(void)argv;
+	(void)argc;
+	(void)flags;
+	uint64_t freed = mem_reclaim(&main_mem);
+	printf("reclaimed %"PRIu64" pages\n", freed);
+	return 0;
+}
+
 // Read 8 bits from address
 static int do_r8(size_t argc, const char *argv[], int *flags)
 {
@@ -211,7 +224,7 @@ static int do_reg(size_t argc, const char *argv[], int *flags)
 	(void)argv;
 	(void)argc;
 	(void)flags;
-	for (int i = 0; i < STEM_NUM_CORES; i++) {
+	for (int i = 0; i < stem_num_cores; i++) {
 		printf("core %d:\n", i);
 		printf("pc:  0x%016"PRIx64"\n", cores[i].pc);
 		printf("sbp: 0x%016"PRIx64"\n", cores[i].sbp);
@@ -344,6 +357,7 @@ static struct menu_item {
 	{ "info", "<arg> - print info on <arg>", do_info },
 	{ "list", "- list source code", do_list },
 	{ "quit", "- terminate program", do_quit },
+	{ "reclaim", "- free memory pages which are all zero", do_reclaim },
 	{ "reg", "- show register values", do_reg },
 	{ "r8", "<addr> - read 8 bits at addr", do_r8 },
 	{ "r16", "<addr> - read 16 bits at addr", do_r16 },
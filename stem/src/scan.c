@@ -0,0 +1,123 @@
+// scan.c
+
+#include "scan.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Kernels never read past the end of their buffers, which may end at the end of a
+// host page
+
+static size_t scan_byte_scalar(const uint8_t *data, size_t len, uint8_t c)
+{
+	size_t i = 0;
+	while (i < len && data[i] != c) i++;
+	return i;
+}
+
+static size_t scan_diff_scalar(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	size_t i = 0;
+	while (i < len && a[i] == b[i]) i++;
+	return i;
+}
+
+#if defined(__x86_64__)
+static size_t scan_byte_sse2(const uint8_t *data, size_t len, uint8_t c)
+{
+	const __m128i needle = _mm_set1_epi8((char)c);
+	size_t i = 0;
+	for (; len - i >= 16; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_byte_scalar(data + i, len - i, c);
+}
+
+static size_t scan_diff_sse2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	size_t i = 0;
+	for (; len - i >= 16; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) ^ 0xffff;
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_diff_scalar(a + i, b + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_byte_avx2(const uint8_t *data, size_t len, uint8_t c)
+{
+	const __m256i needle = _mm256_set1_epi8((char)c);
+	size_t i = 0;
+	for (; len - i >= 32; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_byte_sse2(data + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_diff_avx2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	size_t i = 0;
+	for (; len - i >= 32; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_diff_sse2(a + i, b + i, len - i);
+}
+#endif
+
+// Kernels of the selected level
+static size_t (*scan_byte_kernel)(const uint8_t*, size_t, uint8_t) = scan_byte_scalar;
+static size_t (*scan_diff_kernel)(const uint8_t*, const uint8_t*, size_t) = scan_diff_scalar;
+
+int scan_select(int level)
+{
+	switch (level) {
+	case SCAN_SCALAR:
+		scan_byte_kernel = scan_byte_scalar;
+		scan_diff_kernel = scan_diff_scalar;
+		return 0;
+#if defined(__x86_64__)
+	case SCAN_SSE2:
+		scan_byte_kernel = scan_byte_sse2;
+		scan_diff_kernel = scan_diff_sse2;
+		return 0;
+	case SCAN_AVX2:
+		if (!__builtin_cpu_supports("avx2")) break;
+		scan_byte_kernel = scan_byte_avx2;
+		scan_diff_kernel = scan_diff_avx2;
+		return 0;
+#endif
+	}
+	return 1;
+}
+
+// Selects the best supported level before any core runs
+__attribute__((constructor))
+static void scan_init()
+{
+#if defined(__x86_64__)
+	// CPU features must be detected before they are checked from a constructor
+	__builtin_cpu_init();
+#endif
+	for (int level = SCAN_NUM_LEVELS - 1; scan_select(level); level--);
+}
+
+size_t scan_byte(const uint8_t *data, size_t len, uint8_t c)
+{
+	return scan_byte_kernel(data, len, c);
+}
+
+size_t scan_diff(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	return scan_diff_kernel(a, b, len);
+}
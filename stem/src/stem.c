@@ -1,9 +1,14 @@
 // stem.c
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "bpmap.h"
 #include "core.h"
@@ -16,12 +21,21 @@
 #include "stub.h"
 
 // Variables set by command-line arguments
+const char *arg_cores = NULL;
 const char *arg_cycles = NULL;
 const char *arg_dump = NULL;
+const char *arg_engine = NULL;
+const char *arg_file = NULL;
+const char *arg_file_rw = NULL;
+const char *arg_jit_threshold = NULL;
 const char *arg_help = NULL;
 const char *arg_image = NULL;
 const char *arg_mem_size = NULL;
+const char *arg_mem_backend = NULL;
 const char *arg_bp = NULL;
+const char *arg_stats = NULL;
+const char *arg_stdout_buffer = NULL;
+const char *arg_stdout_buffer_size = NULL;
 
 struct carg_desc arg_descs[] = {
 	{
@@ -42,6 +56,15 @@ struct carg_desc arg_descs[] = {
 		"cycles",
 		"cycles"
 	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--cores",
+		&arg_cores,
+		false,
+		"number of cores, each run on its own host thread",
+		"count"
+	},
 	{
 		CARG_TYPE_NAMED,
 		'\0',
@@ -51,6 +74,15 @@ struct carg_desc arg_descs[] = {
 		"memory size",
 		NULL
 	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--mem-backend",
+		&arg_mem_backend,
+		false,
+		"memory page index (tree, radix, or flat)",
+		"backend"
+	},
 	{
 		CARG_TYPE_NAMED,
 		'd',
@@ -60,6 +92,69 @@ struct carg_desc arg_descs[] = {
 		"hex dump",
 		"dump"
 	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--engine",
+		&arg_engine,
+		false,
+		"execution engine (switch, threaded, block, or jit)",
+		"engine"
+	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--jit-threshold",
+		&arg_jit_threshold,
+		false,
+		"block executions before compilation by the jit engine",
+		"count"
+	},
+	{
+		CARG_TYPE_UNARY,
+		'\0',
+		"--stats",
+		&arg_stats,
+		false,
+		"print execution statistics on exit",
+		NULL
+	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--stdout-buffer",
+		&arg_stdout_buffer,
+		false,
+		"when guest stdout is written (line, full, or none), full by default unless stdout is a terminal",
+		"mode"
+	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--stdout-buffer-size",
+		&arg_stdout_buffer_size,
+		false,
+		"size in bytes of the stdout buffer of each core",
+		"size"
+	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--file",
+		&arg_file,
+		false,
+		"host file the guest may read through the file device, numbered in order with --file-rw",
+		"path"
+	},
+	{
+		CARG_TYPE_NAMED,
+		'\0',
+		"--file-rw",
+		&arg_file_rw,
+		false,
+		"host file the guest may read and write through the file device, created if missing",
+		"path"
+	},
 	{
 		CARG_TYPE_NAMED,
 		'b',
@@ -82,7 +177,120 @@ struct carg_desc arg_descs[] = {
 };
 
 // The cores of the Starch virtual machine
-struct core cores[STEM_NUM_CORES];
+int stem_num_cores = 1;
+struct core cores[STEM_MAX_CORES];
+
+// Whether each core has halted. Emulation ends when the main core halts, while
+// other halted cores are no longer run.
+static bool core_halted[STEM_MAX_CORES];
+
+// Cores other than the main core wait to be started through IO memory
+static struct core_group core_group = { .cores = cores, .count = 1, .next_start = 1 };
+
+// Returns whether the core may run, starting it first if it was waiting and has
+// been started by another core
+static bool core_ready(int corei)
+{
+	return !core_wait_start(cores + corei, &main_mem) && !core_halted[corei];
+}
+
+enum {
+	STEM_SLICE_CYCLES = 0x10000, // Instructions run by a core thread between checks for stopping
+	STEM_WAIT_USEC = 1000, // Time a waiting core thread sleeps between checks for its start
+};
+
+// State of a core run on its own host thread
+struct core_thread {
+	pthread_t thread;
+	int corei;
+	bool limit; // Whether to stop after left instructions
+	uint64_t left;
+	int ret, stop_reason;
+};
+
+// Runs a core in slices until it stops or core_group is asked to stop
+static void *core_thread_run(void *arg)
+{
+	struct core_thread *ct = arg;
+	struct core *core = cores + ct->corei;
+	core->run_opts |= CORE_RUN_CYCLES;
+	ct->ret = 0;
+	ct->stop_reason = CORE_STOP_BUDGET;
+	while (!__atomic_load_n(&core_group.stopping, __ATOMIC_RELAXED)) {
+		if (!core_ready(ct->corei)) {
+			usleep(STEM_WAIT_USEC);
+			continue;
+		}
+		if (ct->limit && ct->left == 0) break;
+		uint64_t slice = STEM_SLICE_CYCLES;
+		if (ct->limit && ct->left < slice) {
+			slice = ct->left;
+		}
+		uint64_t slice_left = slice;
+		ct->ret = core_run(core, &main_mem, &slice_left, &ct->stop_reason);
+		if (ct->limit) {
+			ct->left -= slice - slice_left;
+		}
+		if (ct->stop_reason != CORE_STOP_BUDGET) break;
+	}
+
+	// The machine stops with the main core, and on errors, breakpoints, and nonzero
+	// halt codes on any core
+	if (ct->corei == 0 || ct->stop_reason == CORE_STOP_ERROR ||
+		ct->stop_reason == CORE_STOP_BREAKPOINT || ct->ret > 256) {
+		core_group_stop(&core_group);
+	}
+	return NULL;
+}
+
+// Runs all cores which have not halted concurrently, the main core on the calling
+// thread, until the main core stops. Sets *budget as for core_run on the main
+// core. Returns the result of the main core, unless another core failed or halted
+// with a nonzero code.
+static int run_core_threads(int run_opts, uint64_t *budget, int *flags)
+{
+	struct core_thread threads[STEM_MAX_CORES];
+	core_group.stopping = 0;
+	core_group.threaded = 1;
+	for (int corei = 0; corei < stem_num_cores; corei++) {
+		struct core_thread *ct = threads + corei;
+		ct->corei = corei;
+		ct->limit = (run_opts & CORE_RUN_CYCLES) != 0;
+		ct->left = *budget;
+		cores[corei].run_opts = run_opts;
+		cores[corei].bpmap = bpmap; // The menu may have modified the map
+		cores[corei].bpfilter = &bpfilter;
+		if (corei > 0 && !core_halted[corei]) {
+			if (pthread_create(&ct->thread, NULL, core_thread_run, ct)) {
+				stmsgf(SMT_ERROR, "failed to create thread for core %d", corei);
+				core_halted[corei] = true;
+			}
+		}
+	}
+	core_thread_run(threads);
+
+	int ret = threads[0].ret;
+	for (int corei = 0; corei < stem_num_cores; corei++) {
+		struct core_thread *ct = threads + corei;
+		if (corei > 0) {
+			if (core_halted[corei]) continue;
+			pthread_join(ct->thread, NULL);
+			if (ct->stop_reason == CORE_STOP_HALT) {
+				core_halted[corei] = true;
+			}
+			if (ct->ret < 0 || (ct->ret > 256 && ret >= 0)) {
+				ret = ct->ret;
+			}
+		}
+		if (ct->stop_reason == CORE_STOP_BREAKPOINT) {
+			printf("stem: bp hit on core %d at address %#"PRIx64"\n", corei, cores[corei].pc);
+			*flags &= ~SF_RUN; // Pause processor
+		}
+	}
+	core_group.threaded = 0;
+	*budget = threads[0].left;
+	return ret;
+}
 
 // The main memory of the Starch virtual machine (shared among cores)
 struct mem main_mem;
@@ -90,6 +298,9 @@ struct mem main_mem;
 // Breakpoint map
 struct bpmap *bpmap = NULL;
 
+// Page filter for the breakpoint map
+struct bpfilter bpfilter;
+
 bool non_help_arg = false, arg_error = false;
 void handle_arg(struct carg_desc *desc, const char *arg)
 {
@@ -109,6 +320,60 @@ void handle_arg(struct carg_desc *desc, const char *arg)
 			if (bpmap == NULL) bpmap = bpmap_create();
 			// Note: For now all counts are 1
 			bpmap = bpmap_insert(bpmap, addr, 1);
+			bpfilter_build(&bpfilter, bpmap);
+		}
+	}
+	else if (desc->value == &arg_file || desc->value == &arg_file_rw) {
+		if (core_group.num_files >= CORE_MAX_FILES) {
+			stmsgf(SMT_ERROR, "too many files, the limit is %d", CORE_MAX_FILES);
+			arg_error = true;
+			return;
+		}
+		int fd = desc->value == &arg_file ? open(arg, O_RDONLY) :
+			open(arg, O_RDWR | O_CREAT, 0666);
+		if (fd < 0) {
+			stmsgf(SMT_ERROR, "failed to open file \"%s\"", arg);
+			arg_error = true;
+		}
+		else {
+			core_group.files[core_group.num_files++] = fd;
+		}
+	}
+}
+
+// Prints execution statistics to stderr
+static void print_stats(void)
+{
+	uint64_t cycles = 0;
+	for (int corei = 0; corei < stem_num_cores; corei++) {
+		cycles += cores[corei].cycles;
+	}
+	fprintf(stderr, "stem: cycles: %"PRIu64"\n", cycles);
+	if (main_mem.backend != MEM_BACKEND_FLAT) {
+		fprintf(stderr, "stem: memory pages: %"PRIu64"\n", main_mem.node_count);
+	}
+	for (int corei = 0; corei < stem_num_cores; corei++) {
+		const struct core_tlb *tlb = &cores[corei].tlb;
+		fprintf(stderr, "stem: core %d: tlb hits: %"PRIu64", misses: %"PRIu64"\n",
+			corei, tlb->hits, tlb->misses);
+		// Accesses to a stack which is not pinned take the slower checked paths
+		fprintf(stderr, "stem: core %d: pinned stack: %s\n", corei,
+			cores[corei].stack_host ? "yes" : "no");
+		const struct bcache *bc = &cores[corei].bcache;
+		if (bc->link_hits) {
+			fprintf(stderr, "stem: core %d: linked blocks: %"PRIu64"\n", corei, bc->link_hits);
+		}
+		if (bc->ret_hits || bc->ret_misses) {
+			fprintf(stderr, "stem: core %d: predicted returns: %"PRIu64" of %"PRIu64"\n",
+				corei, bc->ret_hits, bc->ret_hits + bc->ret_misses);
+		}
+		if (bc->jit_blocks) {
+			fprintf(stderr, "stem: core %d: compiled blocks: %"PRIu64"\n", corei, bc->jit_blocks);
+		}
+		for (int fuse = FUSE_NONE + 1; fuse < FUSE_COUNT; fuse++) {
+			if (bc->fuse_counts[fuse] == 0) continue;
+			fprintf(stderr, "stem: core %d: fused %s: %"PRIu64"\n",
+				corei, name_for_fuse(fuse), bc->fuse_counts[fuse]);
 		}
 	}
 }
@@ -161,6 +426,96 @@ int main(int argc, const char *argv[])
 		}
 	}
 
+	// Parse memory backend
+	int mem_backend = MEM_BACKEND_TREE;
+	if (arg_mem_backend) {
+		if (strcmp(arg_mem_backend, "tree") == 0) {
+			mem_backend = MEM_BACKEND_TREE;
+		}
+		else if (strcmp(arg_mem_backend, "radix") == 0) {
+			mem_backend = MEM_BACKEND_RADIX;
+		}
+		else if (strcmp(arg_mem_backend, "flat") == 0) {
+			mem_backend = MEM_BACKEND_FLAT;
+		}
+		else {
+			stmsgf(SMT_ERROR, "invalid memory backend \"%s\"", arg_mem_backend);
+			return 1;
+		}
+	}
+
+	// Parse execution engine
+	int engine = CORE_ENGINE_SWITCH;
+	if (arg_engine) {
+		if (strcmp(arg_engine, "switch") == 0) {
+			engine = CORE_ENGINE_SWITCH;
+		}
+		else if (strcmp(arg_engine, "threaded") == 0) {
+			engine = CORE_ENGINE_THREADED;
+		}
+		else if (strcmp(arg_engine, "block") == 0) {
+			engine = CORE_ENGINE_BLOCK;
+		}
+		else if (strcmp(arg_engine, "jit") == 0) {
+			engine = CORE_ENGINE_JIT;
+		}
+		else {
+			stmsgf(SMT_ERROR, "invalid engine \"%s\"", arg_engine);
+			return 1;
+		}
+	}
+
+	// Parse JIT compilation threshold
+	long int jit_threshold = JIT_DEFAULT_THRESHOLD;
+	if (arg_jit_threshold) {
+		char *endptr = NULL;
+		jit_threshold = strtol(arg_jit_threshold, &endptr, 0);
+		if (*arg_jit_threshold == '\0' || *endptr != '\0' || jit_threshold < 1 || jit_threshold > UINT32_MAX) {
+			stmsgf(SMT_ERROR, "invalid JIT threshold \"%s\"", arg_jit_threshold);
+			return 1;
+		}
+	}
+
+	// Parse stdout buffering. Output to a terminal is line buffered by default so
+	// that it appears promptly, while other output is written in as few calls as possible.
+	int stdout_mode = isatty(1) ? CORE_STDOUT_LINE : CORE_STDOUT_FULL;
+	if (arg_stdout_buffer) {
+		if (strcmp(arg_stdout_buffer, "line") == 0) {
+			stdout_mode = CORE_STDOUT_LINE;
+		}
+		else if (strcmp(arg_stdout_buffer, "full") == 0) {
+			stdout_mode = CORE_STDOUT_FULL;
+		}
+		else if (strcmp(arg_stdout_buffer, "none") == 0) {
+			stdout_mode = CORE_STDOUT_NONE;
+		}
+		else {
+			stmsgf(SMT_ERROR, "invalid stdout buffering \"%s\"", arg_stdout_buffer);
+			return 1;
+		}
+	}
+	long int stdout_size = CORE_STDOUT_SIZE;
+	if (arg_stdout_buffer_size) {
+		char *endptr = NULL;
+		stdout_size = strtol(arg_stdout_buffer_size, &endptr, 0);
+		if (*arg_stdout_buffer_size == '\0' || *endptr != '\0' || stdout_size < 1 || stdout_size > INT_MAX) {
+			stmsgf(SMT_ERROR, "invalid stdout buffer size \"%s\"", arg_stdout_buffer_size);
+			return 1;
+		}
+	}
+
+	// Parse number of cores
+	if (arg_cores) {
+		char *endptr = NULL;
+		long int num_cores = strtol(arg_cores, &endptr, 0);
+		if (*arg_cores == '\0' || *endptr != '\0' || num_cores < 1 || num_cores > STEM_MAX_CORES) {
+			stmsgf(SMT_ERROR, "invalid core count \"%s\"", arg_cores);
+			return 1;
+		}
+		stem_num_cores = num_cores;
+		core_group.count = num_cores;
+	}
+
 	// Open the input image file
 	FILE *infile = fopen(arg_image, "rb");
 	if (infile == NULL) {
@@ -186,7 +541,21 @@ int main(int argc, const char *argv[])
 	}
 
 	// Initialize emulated memory
-	mem_init(&main_mem, mem_size);
+	ret = mem_init(&main_mem, mem_size, mem_backend);
+	if (ret) {
+		fclose(infile);
+		stmsgf(SMT_ERROR, "failed to reserve %#lx bytes of memory", mem_size);
+		return ret;
+	}
+	if (stem_num_cores > 1) {
+		ret = mem_share(&main_mem);
+		if (ret) {
+			fclose(infile);
+			mem_destroy(&main_mem);
+			stmsgf(SMT_ERROR, "failed to share memory among cores");
+			return ret;
+		}
+	}
 
 	// Prepare hard-coded interrupt handlers, which just halt with the interrupt number
 	for (int i = 1; i < 256; i++) {
@@ -195,13 +564,27 @@ int main(int argc, const char *argv[])
 	}
 
 	// Initialize the emulated cores
-	for (int i = 0; i < STEM_NUM_CORES; i++) {
+	for (int i = 0; i < stem_num_cores; i++) {
 		core_init(cores + i);
+		cores[i].id = i;
+		cores[i].num_cores = stem_num_cores;
+		cores[i].group = &core_group;
+		cores[i].waiting = i > 0;
+		cores[i].engine = engine;
+		if (engine == CORE_ENGINE_JIT) {
+			cores[i].jit_threshold = jit_threshold;
+		}
+		if (ret == 0) {
+			ret = core_set_stdout(cores + i, stdout_mode, stdout_size);
+			if (ret) {
+				stmsgf(SMT_ERROR, "failed to allocate %#lx bytes of stdout buffer", stdout_size);
+			}
+		}
 	}
 
 	// Load all sections in input file into memory
 	struct stub_sec sec;
-	for (int si = 0; si < nsec; si++) {
+	for (int si = 0; ret == 0 && si < nsec; si++) {
 		// Load section information
 		ret = stub_load_section(infile, si, &sec);
 		if (ret) {
@@ -221,25 +604,65 @@ int main(int argc, const char *argv[])
 	if (ret == 0) {
 		// Sections loaded. Emulate.
 		int flags = SF_RUN;
-		for (int cycles = 0; (max_cycles < 0 || cycles < max_cycles) && ret >= 0 && ret < 256 && !(flags & SF_EXIT); cycles++) {
-			// Check for hit breakpoint on all cores
-			int count = 0; // Note: Unused for now
-			int corei;
-			for (corei = 0; corei < STEM_NUM_CORES; corei++) {
-				int hit = bpmap_get(bpmap, cores[corei].pc, &count);
-				if (hit) {
-					printf("stem: bp hit on core %d at address %#"PRIx64"\n", corei, cores[corei].pc);
-					flags &= ~SF_RUN; // Pause processor
-					break;
+		uint64_t budget = max_cycles;
+
+		// Check for breakpoints at the initial pc of all cores
+		int count = 0; // Note: Unused for now
+		int corei;
+		for (corei = 0; corei < stem_num_cores; corei++) {
+			if (cores[corei].waiting) continue;
+			if (bpmap_get(bpmap, cores[corei].pc, &count)) {
+				printf("stem: bp hit on core %d at address %#"PRIx64"\n", corei, cores[corei].pc);
+				flags &= ~SF_RUN; // Pause processor
+				break;
+			}
+		}
+
+		while (ret >= 0 && ret < 256 && !(flags & SF_EXIT)) {
+			if (max_cycles >= 0 && budget == 0) break;
+			if (!(flags & SF_RUN)) {
+				// Show guest output before the menu
+				for (corei = 0; corei < stem_num_cores; corei++) {
+					core_flush_stdout(cores + corei);
 				}
 			}
 			ret = do_menu(&flags); // Present debug menu if appropriate
-			if (ret != 0) break;
+			if (ret != 0 || (flags & SF_EXIT)) break;
 
-			// Step all cores
-			for (corei = 0; corei < STEM_NUM_CORES; corei++) {
-				ret = core_step(cores + corei, &main_mem);
+			// Select the run loop for the enabled features
+			int run_opts = 0;
+			if (bpmap) run_opts |= CORE_RUN_BREAKPOINTS;
+			if (max_cycles >= 0) run_opts |= CORE_RUN_CYCLES;
+			if (!(flags & SF_RUN)) run_opts |= CORE_RUN_MENU;
+
+			if (stem_num_cores > 1 && !(run_opts & CORE_RUN_MENU)) {
+				// Run the cores concurrently on host threads
+				ret = run_core_threads(run_opts, &budget, &flags);
+				continue;
+			}
+
+			// Run all cores in turn until they stop
+			uint64_t left = budget;
+			for (corei = 0; corei < stem_num_cores; corei++) {
+				int stop_reason;
+				if (!core_ready(corei)) continue;
+				left = budget;
+				cores[corei].run_opts = run_opts;
+				cores[corei].bpmap = bpmap; // The menu may have modified the map
+				cores[corei].bpfilter = &bpfilter;
+				ret = core_run(cores + corei, &main_mem, &left, &stop_reason);
+				if (stop_reason == CORE_STOP_BREAKPOINT) {
+					printf("stem: bp hit on core %d at address %#"PRIx64"\n", corei, cores[corei].pc);
+					flags &= ~SF_RUN; // Pause processor
+				}
+				if (corei > 0 && ret == 256) {
+					// Other cores halting with code zero do not halt the machine
+					core_halted[corei] = true;
+					ret = 0;
+				}
+				if (ret < 0 || ret >= 256) break;
 			}
+			budget = left;
 		}
 		if (ret < 0) {
 			stmsgf(SMT_ERROR, "an error occurred during emulation");
@@ -248,6 +671,10 @@ int main(int argc, const char *argv[])
 			ret -= 256;
 		}
 
+		if (arg_stats) {
+			print_stats();
+		}
+
 		// Create a hex dump if requested
 		if (arg_dump) {
 			FILE *dumpfile = fopen(arg_dump, "wb");
@@ -267,10 +694,13 @@ int main(int argc, const char *argv[])
 
 	// Clean up
 	mem_destroy(&main_mem);
-	for (int i = 0; i < STEM_NUM_CORES; i++) {
+	for (int i = 0; i < stem_num_cores; i++) {
 		core_destroy(cores + i);
 	}
 	fclose(infile);
+	for (int i = 0; i < core_group.num_files; i++) {
+		close(core_group.files[i]);
+	}
 	bpmap_delete(bpmap);
 	end_menu();
 	return ret;
@@ -0,0 +1,41 @@
+// coretest.c
+
+#include <assert.h>
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core.h"
+
+// Asserts that the given member of struct core lies within the hot block
+#define ASSERT_HOT(member) assert(offsetof(struct core, member) + \
+	sizeof(((struct core*)0)->member) <= CORE_HOT_SIZE)
+
+int main(void)
+{
+	//
+	// Test that the hot state occupies the first cache line of the core
+	//
+	ASSERT_HOT(pc);
+	ASSERT_HOT(sbp);
+	ASSERT_HOT(sfp);
+	ASSERT_HOT(sp);
+	ASSERT_HOT(slp);
+	ASSERT_HOT(stack_host);
+	ASSERT_HOT(stack_addr);
+	ASSERT_HOT(stack_gen);
+	assert(offsetof(struct core, pc) == 0);
+
+	//
+	// Test that cores in an array do not share cache lines
+	//
+	assert(alignof(struct core) % CORE_HOT_SIZE == 0);
+	assert(sizeof(struct core) % CORE_HOT_SIZE == 0);
+
+	//
+	// Test that the cold IO state is outside the hot block
+	//
+	assert(offsetof(struct core, io) >= CORE_HOT_SIZE);
+
+	return 0;
+}
@@ -3,18 +3,359 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 
 #include "mem.c"
 
 enum {
 	TEST_MEM_SIZE = 0x100000, // 1MiB
+	BENCH_MEM_SIZE = 0x40000000, // 1GiB
+	BENCH_PAGES = 0x4000, // Pages touched by the benchmark
+	BENCH_CYCLES = 10000000, // Accesses made by the benchmark
 };
 
-int main()
+// Test writing and reading random values with the given backend
+static void test_read_write(int backend)
 {
 	struct mem mem;
-	mem_init(&mem, TEST_MEM_SIZE);
+	int ret = mem_init(&mem, TEST_MEM_SIZE, backend);
+	assert(ret == 0);
+
+	uint64_t addr;
+	enum { NUM_CYCLES = 1000 };
+	for (int i = 0; i < NUM_CYCLES; i++) {
+		// Generate random values to read and write
+		uint8_t valread8, valwrite8 = random();
+		uint16_t valread16, valwrite16 = random();
+		uint32_t valread32, valwrite32 = random();
+		uint64_t valread64, valwrite64 = random();
+		// Write/read 8 bit
+		addr = (uint64_t)random() % TEST_MEM_SIZE;
+		ret = mem_write8(&mem, addr, valwrite8);
+		assert(ret == 0);
+		valread8 = ~valwrite8;
+		ret = mem_read8(&mem, addr, &valread8);
+		assert(ret == 0 && valread8 == valwrite8);
+		// Write/read 16 bit
+		addr = (uint64_t)random() % (TEST_MEM_SIZE - 1);
+		ret = mem_write16(&mem, addr, valwrite16);
+		assert(ret == 0);
+		valread16 = ~valwrite16;
+		ret = mem_read16(&mem, addr, &valread16);
+		assert(ret == 0 && valread16 == valwrite16);
+		// Verify little-endian
+		ret = mem_read8(&mem, addr, &valread8);
+		assert(ret == 0 && valread8 == (valread16 & 0xff));
+		ret = mem_read8(&mem, addr + 1, &valread8);
+		assert(ret == 0 && valread8 == (valread16 >> 8));
+		// Write/read 32 bit
+		addr = (uint64_t)random() % (TEST_MEM_SIZE - 3);
+		ret = mem_write32(&mem, addr, valwrite32);
+		assert(ret == 0);
+		valread32 = ~valwrite32;
+		ret = mem_read32(&mem, addr, &valread32);
+		assert(ret == 0 && valread32 == valwrite32);
+		// Verify little-endian
+		ret = mem_read16(&mem, addr, &valread16);
+		assert(ret == 0 && valread16 == (valread32 & 0xffff));
+		ret = mem_read16(&mem, addr + 2, &valread16);
+		assert(ret == 0 && valread16 == (valread32 >> 16));
+		// Write/read 64 bit
+		addr = (uint64_t)random() % (TEST_MEM_SIZE - 7);
+		ret = mem_write64(&mem, addr, valwrite64);
+		assert(ret == 0);
+		valread64 = ~valwrite64;
+		ret = mem_read64(&mem, addr, &valread64);
+		assert(ret == 0 && valread64 == valwrite64);
+		// Verify little-endian
+		ret = mem_read32(&mem, addr, &valread32);
+		assert(ret == 0 && valread32 == (valread64 & 0xffffffff));
+		ret = mem_read32(&mem, addr + 4, &valread32);
+		assert(ret == 0 && valread32 == (valread64 >> 32));
+	}
+
+	// Test out of range accesses
+	uint8_t temp_u8 = 0;
+	ret = mem_write8(&mem, TEST_MEM_SIZE, 0);
+	assert(ret != 0);
+	ret = mem_read8(&mem, TEST_MEM_SIZE, &temp_u8);
+	assert(ret != 0);
+	ret = mem_write64(&mem, TEST_MEM_SIZE - 4, 0);
+	assert(ret != 0);
+	ret = mem_write64(&mem, TEST_MEM_SIZE - 8, 0x0807060504030201);
+	assert(ret == 0);
+	ret = mem_read8(&mem, TEST_MEM_SIZE - 1, &temp_u8);
+	assert(ret == 0 && temp_u8 == 8);
+
+	// Test accesses which cross a page boundary
+	uint64_t temp_u64 = 0;
+	uint32_t temp_u32 = 0;
+	ret = mem_write64(&mem, MEM_PAGE_SIZE * 4 - 3, 0x1122334455667788);
+	assert(ret == 0);
+	ret = mem_read64(&mem, MEM_PAGE_SIZE * 4 - 3, &temp_u64);
+	assert(ret == 0 && temp_u64 == 0x1122334455667788);
+	ret = mem_read32(&mem, MEM_PAGE_SIZE * 4 - 2, &temp_u32);
+	assert(ret == 0 && temp_u32 == 0x44556677);
+	ret = mem_read8(&mem, MEM_PAGE_SIZE * 4, &temp_u8);
+	assert(ret == 0 && temp_u8 == 0x55);
+
+	// Test that writes to code pages are noted
+	uint64_t code_gen = mem.code_gen, map_gen = mem.map_gen;
+	ret = mem_mark_code(&mem, MEM_PAGE_SIZE);
+	assert(ret == 0 && mem.map_gen == map_gen + 1);
+	ret = mem_write8(&mem, MEM_PAGE_SIZE * 2 - 1, 0);
+	assert(ret == 0 && mem.code_gen == code_gen + 1);
+	ret = mem_write8(&mem, MEM_PAGE_SIZE * 2 - 1, 0);
+	assert(ret == 0 && mem.code_gen == code_gen + 1);
+
+	// Test that a hex dump of all memory succeeds
+	FILE *null_file = fopen("/dev/null", "w");
+	assert(null_file != NULL);
+	ret = mem_dump_hex(&mem, 0, 0, null_file);
+	assert(ret == 0);
+	fclose(null_file);
+
+	mem_destroy(&mem);
+}
+
+// Test that pages are visited in address order by the given backend
+static int order_iter_func(struct mem_node *node, struct iter_params *params)
+{
+	uint64_t *next_addr = (uint64_t*)params->user_ptr;
+	assert(node->addr >= *next_addr);
+	*next_addr = node->addr + MEM_PAGE_SIZE;
+	return 0;
+}
+static void test_order(int backend)
+{
+	struct mem mem;
+	int ret = mem_init(&mem, BENCH_MEM_SIZE, backend);
+	assert(ret == 0);
+	enum { NUM_PAGES = 100 };
+	for (int i = 0; i < NUM_PAGES; i++) {
+		ret = mem_write8(&mem, (uint64_t)random() % BENCH_MEM_SIZE, 1);
+		assert(ret == 0);
+	}
+	uint64_t next_addr = 0;
+	struct iter_params params;
+	params.begin_addr = 0;
+	params.end_addr = 0;
+	params.iter_func = order_iter_func;
+	params.user_ptr = &next_addr;
+	if (backend == MEM_BACKEND_RADIX) {
+		ret = mem_radix_iterate(mem.radix, mem.radix_levels - 1, 0, &params);
+	}
+	else {
+		ret = mem_node_iterate(mem.root, &params);
+	}
+	assert(ret == 0 && next_addr != 0);
+	mem_destroy(&mem);
+}
+
+// Returns the current time in seconds
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Times random 64-bit accesses to pages scattered through memory with the given backend
+static void bench(int backend, const char *name)
+{
+	struct mem mem;
+	int ret = mem_init(&mem, BENCH_MEM_SIZE, backend);
+	assert(ret == 0);
+
+	// Pick the pages to access, the same for each backend
+	srandom(1);
+	uint64_t *pages = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_PAGES);
+	for (int i = 0; i < BENCH_PAGES; i++) {
+		pages[i] = ((uint64_t)random() % (BENCH_MEM_SIZE / MEM_PAGE_SIZE)) * MEM_PAGE_SIZE;
+	}
+
+	double begin = now();
+	uint64_t sum = 0, val = 0;
+	for (int i = 0; i < BENCH_CYCLES; i++) {
+		uint64_t addr = pages[(unsigned)random() % BENCH_PAGES] + (i & 0xff8);
+		if (i & 1) {
+			mem_write64(&mem, addr, i);
+		}
+		else {
+			mem_read64(&mem, addr, &val);
+			sum += val;
+		}
+	}
+	double elapsed = now() - begin;
+	printf("%s: %d accesses in %.3f s (checksum %"PRIx64")\n",
+		name, BENCH_CYCLES, elapsed, sum);
+
+	free(pages);
+	mem_destroy(&mem);
+}
+
+// Checks that the given tree is balanced with correct depths. Returns its depth.
+static int test_balance(struct mem_node *node)
+{
+	if (!node) return -1;
+	int prevd = test_balance(node->prev), nextd = test_balance(node->next);
+	int maxd = prevd > nextd ? prevd : nextd;
+	assert(node->depth == maxd + 1 && prevd - nextd <= 1 && prevd - nextd >= -1);
+	return node->depth;
+}
+
+// Test that untouched pages read as zero without allocation, and that pages
+// which return to zero are reclaimed, with the given backend
+static void test_reclaim(int backend)
+{
+	struct mem mem;
+	int ret = mem_init(&mem, TEST_MEM_SIZE, backend);
+	assert(ret == 0);
+
+	// Reads of untouched memory
+	uint64_t val = 1;
+	for (uint64_t addr = 0; addr < TEST_MEM_SIZE; addr += MEM_PAGE_SIZE / 2) {
+		ret = mem_read64(&mem, addr, &val);
+		assert(ret == 0 && val == 0);
+	}
+	assert(mem.node_count == 0 && mem_reclaim(&mem) == 0);
+
+	// Zero pages are freed, while other pages and code pages are kept
+	enum { PAGES = 10 };
+	for (int i = 0; i < PAGES; i++) {
+		ret = mem_write64(&mem, i * MEM_PAGE_SIZE + 8, 0x1234);
+		assert(ret == 0);
+	}
+	ret = mem_write64(&mem, 3 * MEM_PAGE_SIZE + 8, 0);
+	assert(ret == 0);
+	ret = mem_write64(&mem, 7 * MEM_PAGE_SIZE + 8, 0);
+	assert(ret == 0);
+	ret = mem_mark_code(&mem, 7 * MEM_PAGE_SIZE);
+	assert(ret == 0);
+	uint64_t map_gen = mem.map_gen;
+	assert(mem_reclaim(&mem) == 1 && mem.map_gen != map_gen);
+	assert(mem_reclaim(&mem) == 0);
+	for (int i = 0; i < PAGES; i++) {
+		ret = mem_read64(&mem, i * MEM_PAGE_SIZE + 8, &val);
+		assert(ret == 0 && val == (i == 3 || i == 7 ? 0 : 0x1234));
+	}
+	if (backend != MEM_BACKEND_FLAT) {
+		assert(mem.node_count == PAGES - 1);
+		if (backend == MEM_BACKEND_TREE) test_balance(mem.root);
+	}
+
+	// A reclaimed page can be written again
+	ret = mem_write64(&mem, 3 * MEM_PAGE_SIZE + 8, 5);
+	assert(ret == 0);
+	ret = mem_read64(&mem, 3 * MEM_PAGE_SIZE + 8, &val);
+	assert(ret == 0 && val == 5);
+
+	// Zero page pointers are invalidated when the page is allocated
+	uint8_t *data = mem_page_data(&mem, 20 * MEM_PAGE_SIZE, 0);
+	assert(data != NULL && data[0] == 0);
+	map_gen = mem.map_gen;
+	ret = mem_write8(&mem, 20 * MEM_PAGE_SIZE, 1);
+	assert(ret == 0);
+	assert(backend == MEM_BACKEND_FLAT || mem.map_gen != map_gen);
+
+	mem_destroy(&mem);
+}
+
+// Test that a pinned region stays coherent with other accesses with the given backend
+static void test_pin(int backend)
+{
+	struct mem mem;
+	int ret = mem_init(&mem, TEST_MEM_SIZE, backend);
+	assert(ret == 0);
+
+	// Data written before pinning is kept
+	ret = mem_write64(&mem, 0x4008, 0x1122334455667788);
+	assert(ret == 0);
+	uint8_t *host = mem_pin(&mem, 0x4010, 0x2000);
+	assert(host != NULL && get_little64(host - 8) == 0x1122334455667788);
+
+	// Stores through the pointer are seen by loads and dumps, and vice versa
+	uint64_t val = 0;
+	put_little64(0xaabbccdd, host + 0x1000);
+	ret = mem_read64(&mem, 0x5010, &val);
+	assert(ret == 0 && val == 0xaabbccdd);
+	ret = mem_write32(&mem, 0x6000, 0x12345678);
+	assert(ret == 0 && get_little32(host + 0x1ff0) == 0x12345678);
+	char buf[256] = {};
+	FILE *hex_file = fmemopen(buf, sizeof(buf) - 1, "w");
+	ret = mem_dump_hex(&mem, 0x5000, 0x1000, hex_file);
+	fclose(hex_file);
+	assert(ret == 0 && strstr(buf, "0000000000005010: dd cc bb aa") == buf);
+
+	// Pinning the same range again returns the same buffer. Overlaps are refused.
+	assert(mem_pin(&mem, 0x4010, 0x2000) == host);
+	assert(mem_pin(&mem, 0x6000, 0x1000) == NULL || backend == MEM_BACKEND_FLAT);
+	assert(mem_pin(&mem, 0, MEM_PIN_MAX_SIZE + 1) == NULL);
+
+	// Code in a pinned region prevents pinning it again
+	ret = mem_mark_code(&mem, 0x4000);
+	assert(ret == 0);
+	assert(mem_pin(&mem, 0x4010, 0x2000) == NULL);
+	uint64_t code_gen = mem.code_gen;
+	ret = mem_write8(&mem, 0x4000, 1);
+	assert(ret == 0 && mem.code_gen == code_gen + 1);
+	host = mem_pin(&mem, 0x4010, 0x2000);
+	assert(host != NULL);
+
+	// Data is kept when unpinned
+	uint64_t map_gen = mem.map_gen;
+	mem_unpin(&mem, 0x4010);
+	assert(backend == MEM_BACKEND_FLAT || (mem.pin_count == 0 && mem.map_gen != map_gen));
+	ret = mem_read64(&mem, 0x5010, &val);
+	assert(ret == 0 && val == 0xaabbccdd);
+	ret = mem_read64(&mem, 0x4008, &val);
+	assert(ret == 0 && val == 0x1122334455667788);
+
+	mem_destroy(&mem);
+}
+
+static void test_share(int backend)
+{
+	struct mem mem;
+	int ret = mem_init(&mem, TEST_MEM_SIZE, backend);
+	assert(ret == 0);
+	ret = mem_share(&mem);
+	assert(ret == 0 && mem.shared);
+
+	// Accesses behave as before
+	uint64_t val = 0;
+	ret = mem_write64(&mem, 0x4008, 0x1122334455667788);
+	assert(ret == 0);
+	ret = mem_read64(&mem, 0x4008, &val);
+	assert(ret == 0 && val == 0x1122334455667788);
+
+	// Page data is 8 byte aligned for atomic operations
+	uint8_t *data = mem_page_data(&mem, 0x4000, 1);
+	assert(data != NULL && ((uintptr_t)data & 7) == 0);
+
+	// Pages are not moved out of the page index while other threads may use them
+	assert((mem_pin(&mem, 0x4000, 0x1000) == NULL) == (backend != MEM_BACKEND_FLAT));
+
+	// Ranges never written are pinned in place, and the buffer is kept after
+	// unpinning while other threads may still hold pointers into it
+	uint8_t *host = mem_pin(&mem, 0x10000, 0x2000);
+	assert(host != NULL);
+	put_little64(0xaabbccdd, host + 0x1000);
+	ret = mem_read64(&mem, 0x11000, &val);
+	assert(ret == 0 && val == 0xaabbccdd);
+	mem_unpin(&mem, 0x10000);
+	assert(backend == MEM_BACKEND_FLAT || (mem.pin_count == 0 && mem.retired_count == 1));
+	ret = mem_read64(&mem, 0x11000, &val);
+	assert(ret == 0 && val == 0xaabbccdd);
+
+	mem_destroy(&mem);
+}
+
+int main(int argc, const char *argv[])
+{
+	struct mem mem;
+	mem_init(&mem, TEST_MEM_SIZE, MEM_BACKEND_TREE);
 
 	//
 	// Test initial conditions
@@ -37,7 +378,6 @@ int main()
 	//
 	// Test tree balancing
 	//
-	uint8_t temp_u8;
 	enum { BALANCE_CYCLES = TEST_MEM_SIZE / MEM_PAGE_SIZE };
 	// Generate an array of sorted page indices
 	int *spi = (int*)malloc(sizeof(int) * BALANCE_CYCLES);
@@ -56,9 +396,8 @@ int main()
 	}
 	free(spi);
 	for (int i = 0; i < BALANCE_CYCLES; i++) {
-		temp_u8 = 1;
-		ret = mem_read8(&mem, upi[i] * MEM_PAGE_SIZE, &temp_u8);
-		assert(mem.root != NULL && temp_u8 == 0);
+		ret = mem_write8(&mem, upi[i] * MEM_PAGE_SIZE, 1);
+		assert(ret == 0 && mem.root != NULL);
 		int maxd = -1, prevd = -1, nextd = -1;
 		if (mem.root->prev) {
 			prevd = mem.root->prev->depth;
@@ -73,64 +412,52 @@ int main()
 	}
 	free(upi);
 
-	mem_destroy(&mem);
-	mem_init(&mem, TEST_MEM_SIZE);
-
-	// Test writing and reading random values
-	uint64_t addr;
-	enum { NUM_CYCLES = 1000 };
-	for (int i = 0; i < NUM_CYCLES; i++) {
-		// Generate random values to read and write
-		uint8_t valread8, valwrite8 = random();
-		uint16_t valread16, valwrite16 = random();
-		uint32_t valread32, valwrite32 = random();
-		uint64_t valread64, valwrite64 = random();
-		// Write/read 8 bit
-		addr = (uint64_t)random() % TEST_MEM_SIZE;
-		ret = mem_write8(&mem, addr, valwrite8);
-		assert(ret == 0);
-		valread8 = ~valwrite8;
-		ret = mem_read8(&mem, addr, &valread8);
-		assert(ret == 0 && valread8 == valwrite8);
-		// Write/read 16 bit
-		addr = (uint64_t)random() % (TEST_MEM_SIZE - 1);
-		ret = mem_write16(&mem, addr, valwrite16);
-		assert(ret == 0);
-		valread16 = ~valwrite16;
-		ret = mem_read16(&mem, addr, &valread16);
-		assert(ret == 0 && valread16 == valwrite16);
-		// Verify little-endian
-		ret = mem_read8(&mem, addr, &valread8);
-		assert(ret == 0 && valread8 == (valread16 & 0xff));
-		ret = mem_read8(&mem, addr + 1, &valread8);
-		assert(ret == 0 && valread8 == (valread16 >> 8));
-		// Write/read 32 bit
-		addr = (uint64_t)random() % (TEST_MEM_SIZE - 3);
-		ret = mem_write32(&mem, addr, valwrite32);
+	// Test that reclaiming zero pages keeps the tree balanced
+	for (int i = 0; i < BALANCE_CYCLES; i += 3) {
+		ret = mem_write8(&mem, i * MEM_PAGE_SIZE, 0);
 		assert(ret == 0);
-		valread32 = ~valwrite32;
-		ret = mem_read32(&mem, addr, &valread32);
-		assert(ret == 0 && valread32 == valwrite32);
-		// Verify little-endian
-		ret = mem_read16(&mem, addr, &valread16);
-		assert(ret == 0 && valread16 == (valread32 & 0xffff));
-		ret = mem_read16(&mem, addr + 2, &valread16);
-		assert(ret == 0 && valread16 == (valread32 >> 16));
-		// Write/read 64 bit
-		addr = (uint64_t)random() % (TEST_MEM_SIZE - 7);
-		ret = mem_write64(&mem, addr, valwrite64);
-		assert(ret == 0);
-		valread64 = ~valwrite64;
-		ret = mem_read64(&mem, addr, &valread64);
-		assert(ret == 0 && valread64 == valwrite64);
-		// Verify little-endian
-		ret = mem_read32(&mem, addr, &valread32);
-		assert(ret == 0 && valread32 == (valread64 & 0xffffffff));
-		ret = mem_read32(&mem, addr + 4, &valread32);
-		assert(ret == 0 && valread32 == (valread64 >> 32));
 	}
+	uint64_t freed = mem_reclaim(&mem);
+	assert(freed == (BALANCE_CYCLES + 2) / 3 && mem.node_count == BALANCE_CYCLES - freed);
+	test_balance(mem.root);
 
 	mem_destroy(&mem);
 
+	// Test each backend
+	test_reclaim(MEM_BACKEND_TREE);
+	test_reclaim(MEM_BACKEND_RADIX);
+	test_reclaim(MEM_BACKEND_FLAT);
+	test_pin(MEM_BACKEND_TREE);
+	test_pin(MEM_BACKEND_RADIX);
+	test_pin(MEM_BACKEND_FLAT);
+	test_share(MEM_BACKEND_TREE);
+	test_share(MEM_BACKEND_RADIX);
+	test_share(MEM_BACKEND_FLAT);
+	test_read_write(MEM_BACKEND_TREE);
+	test_read_write(MEM_BACKEND_RADIX);
+	test_read_write(MEM_BACKEND_FLAT);
+	test_order(MEM_BACKEND_TREE);
+	test_order(MEM_BACKEND_RADIX);
+
+	// Test radix table depth
+	mem_init(&mem, MEM_PAGE_SIZE * MEM_RADIX_FANOUT, MEM_BACKEND_RADIX);
+	assert(mem.radix_levels == 1);
+	mem_destroy(&mem);
+	mem_init(&mem, MEM_PAGE_SIZE * MEM_RADIX_FANOUT + 1, MEM_BACKEND_RADIX);
+	assert(mem.radix_levels == 2);
+	mem_destroy(&mem);
+	mem_init(&mem, UINT64_MAX, MEM_BACKEND_RADIX);
+	assert(mem.radix_levels == 6);
+	ret = mem_write8(&mem, UINT64_MAX - 1, 1);
+	assert(ret == 0);
+	mem_destroy(&mem);
+
+	// Benchmark each backend if requested
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench(MEM_BACKEND_TREE, "tree");
+		bench(MEM_BACKEND_RADIX, "radix");
+		bench(MEM_BACKEND_FLAT, "flat");
+	}
+
 	return 0;
 }
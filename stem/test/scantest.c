@@ -0,0 +1,87 @@
+// scantest.c
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "scan.h"
+
+enum {
+	TEST_MAX_LEN = 200, // Longest buffer tested
+	TEST_MAX_OFF = 64,  // Largest buffer offset tested
+};
+
+// Reference implementations
+static size_t ref_byte(const uint8_t *data, size_t len, uint8_t c)
+{
+	const uint8_t *p = memchr(data, c, len);
+	return p ? (size_t)(p - data) : len;
+}
+
+static size_t ref_diff(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	size_t i = 0;
+	while (i < len && a[i] == b[i]) i++;
+	return i;
+}
+
+int main(void)
+{
+	// Buffers are placed at the end of a page followed by an inaccessible page,
+	// so that a kernel reading past the end of its buffer faults
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	uint8_t *pages = mmap(NULL, 4 * page_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	assert(pages != MAP_FAILED);
+	int ret = mprotect(pages + page_size, page_size, PROT_NONE);
+	ret |= mprotect(pages + 3 * page_size, page_size, PROT_NONE);
+	assert(ret == 0);
+	uint8_t *a_end = pages + page_size, *b_end = pages + 3 * page_size;
+
+	srandom(1);
+	int levels = 0;
+	for (int level = 0; level < SCAN_NUM_LEVELS; level++) {
+		if (scan_select(level)) continue;
+		levels++;
+		for (size_t len = 0; len <= TEST_MAX_LEN; len++) {
+			for (size_t off = 0; off <= TEST_MAX_OFF; off += 7) {
+				uint8_t *a = a_end - len - off, *b = b_end - len - off;
+				//
+				// Test scans of random bytes, which are often missing the value
+				//
+				for (size_t i = 0; i < len; i++) {
+					a[i] = (uint8_t)(random() % 64 + 1);
+				}
+				for (int c = 0; c < 4; c++) {
+					assert(scan_byte(a, len, c) == ref_byte(a, len, c));
+				}
+				// Test a match at every position
+				for (size_t i = 0; i < len; i++) {
+					uint8_t saved = a[i];
+					a[i] = 0;
+					assert(scan_byte(a, len, 0) == ref_byte(a, len, 0));
+					a[i] = saved;
+				}
+
+				//
+				// Test differences at every position
+				//
+				memcpy(b, a, len);
+				assert(scan_diff(a, b, len) == len);
+				for (size_t i = 0; i < len; i++) {
+					b[i] ^= 1 << (i % 8);
+					assert(scan_diff(a, b, len) == i);
+					assert(scan_diff(a, b, len) == ref_diff(a, b, len));
+					b[i] = a[i];
+				}
+			}
+		}
+	}
+	assert(levels > 0);
+	assert(scan_select(SCAN_NUM_LEVELS) != 0);
+
+	munmap(pages, 4 * page_size);
+	return 0;
+}
@@ -61,6 +61,10 @@ test_begin testing smap
 ../util/test/smaptest
 test_begin testing emulated memory
 ../stem/test/memtest
+test_begin testing core layout
+../stem/test/coretest
+test_begin testing byte scanning
+../stem/test/scantest
 test_begin testing utf8 library
 ../util/test/utf8test
 test_begin testing literal parsing
@@ -231,5 +235,150 @@ $STEM a.stb
 test_begin testing interrupts
 $STASM test-int.sta
 $STEM a.stb
+test_begin testing self-modifying code
+$STASM test-smc.sta
+$STEM a.stb
+test_begin testing self-modifying code on multiple cores
+$STASM test-smc-cores.sta
+$STEM a.stb
+for BACKEND in tree radix flat; do
+	for ENGINE in switch block jit; do
+		$STEM --cores 2 --mem-backend=$BACKEND --engine=$ENGINE --jit-threshold=1 a.stb
+	done
+done
+test_begin testing stack access interrupts
+$STASM test-stack.sta
+$STEM a.stb
+test_begin testing atomic operations
+$STASM test-atomic.sta
+$STEM a.stb
+test_begin testing atomic operations on multiple cores
+for CORES in 2 4; do
+	for BACKEND in tree radix flat; do
+		$STEM --cores $CORES --mem-backend=$BACKEND a.stb
+		$STEM --cores $CORES --mem-backend=$BACKEND --engine=jit a.stb
+	done
+done
+test_begin testing stacks of multiple cores are pinned
+for BACKEND in tree radix flat; do
+	$STEM --cores 2 --mem-backend=$BACKEND --stats a.stb 2> stats.txt
+	grep -q "core 0: pinned stack: yes" stats.txt
+	grep -q "core 1: pinned stack: yes" stats.txt
+done
+rm stats.txt
+test_begin testing mailboxes
+$STASM test-mailbox.sta
+$STEM a.stb
+test_begin testing mailboxes on multiple cores
+for ENGINE in switch threaded jit; do
+	$STEM --cores 2 --engine=$ENGINE a.stb
+	$STEM --cores 3 --engine=$ENGINE a.stb
+done
+test_begin testing bulk memory operations
+$STASM test-bulk.sta
+$STEM a.stb
+for BACKEND in tree radix flat; do
+	$STEM --mem-backend=$BACKEND a.stb
+done
+test_begin testing vector operations
+$STASM test-vector.sta
+$STEM a.stb
+test_begin testing file device
+$STASM test-file.sta
+for ENGINE in switch threaded block jit; do
+	rm -f file.out
+	$STEM --engine=$ENGINE --file test-file.sta --file-rw file.out a.stb
+	cmp test-file.sta file.out
+done
+rm file.out
+test_begin testing bulk stdin and stdout
+$STASM test-stdio.sta
+for ENGINE in switch threaded block jit; do
+	$STEM --engine=$ENGINE a.stb < test-int.sta > stdio.out
+	cmp test-int.sta stdio.out
+	cat test-int.sta | $STEM --engine=$ENGINE a.stb | cmp - test-int.sta
+done
+rm stdio.out
+test_begin testing stdout buffering
+$STASM test-stdout.sta
+$STEM --stdout-buffer=line a.stb > stdout.out
+[ $(wc -l < stdout.out) -eq 1000 ]
+[ "$(tail -c 5 stdout.out)" = "$(printf 'z\nend')" ]
+for MODE in line full none; do
+	for ENGINE in switch jit; do
+		$STEM --stdout-buffer=$MODE --engine=$ENGINE a.stb | cmp - stdout.out
+		$STEM --stdout-buffer=$MODE --stdout-buffer-size=100 --engine=$ENGINE a.stb | cmp - stdout.out
+	done
+done
+# Output buffered when emulation stops without a halt is still written
+[ -n "$($STEM --stdout-buffer=full --cycles 5000 a.stb)" ]
+rm stdout.out
+test_begin testing string operations
+$STASM test-string.sta
+for ENGINE in switch threaded block jit; do
+	$STEM --mem-size 0x10800 --engine=$ENGINE a.stb
+done
+for BACKEND in radix flat; do
+	$STEM --mem-size 0x10800 --mem-backend=$BACKEND a.stb
+done
+
+# Run individual tests on the other execution engines
+for ENGINE in threaded block jit; do
+	test_begin testing $ENGINE engine
+	for TEST in test-add-sub test-mul-div-mod test-bit-ops test-int test-smc test-stack test-atomic test-mailbox test-bulk test-vector; do
+		$STASM $TEST.sta
+		$STEM --engine=$ENGINE a.stb
+	done
+	test_begin testing $ENGINE engine matches switch engine
+	$STASM test-int.sta
+	for CYCLES in 1 17 100 100000; do
+		A=0; $STEM --cycles $CYCLES --dump a.sth a.stb || A=$?
+		B=0; $STEM --engine=$ENGINE --cycles $CYCLES --dump b.sth a.stb || B=$?
+		[ $A -eq $B ]
+		cmp a.sth b.sth
+	done
+done
+test_begin testing jit engine with immediate compilation matches switch engine
+for TEST in test-int test-smc; do
+	$STASM $TEST.sta
+	for CYCLES in 1 17 100 100000; do
+		A=0; $STEM --cycles $CYCLES --dump a.sth a.stb || A=$?
+		B=0; $STEM --engine=jit --jit-threshold=1 --cycles $CYCLES --dump b.sth a.stb || B=$?
+		[ $A -eq $B ]
+		cmp a.sth b.sth
+	done
+done
+for BACKEND in radix flat; do
+	test_begin testing $BACKEND memory backend matches tree backend
+	for TEST in test-int test-smc; do
+		$STASM $TEST.sta
+		A=0; $STEM --dump a.sth a.stb || A=$?
+		B=0; $STEM --mem-backend=$BACKEND --dump b.sth a.stb || B=$?
+		[ $A -eq $B ]
+		cmp a.sth b.sth
+		B=0; $STEM --mem-backend=$BACKEND --engine=jit --dump b.sth a.stb || B=$?
+		[ $A -eq $B ]
+		cmp a.sth b.sth
+	done
+done
+test_begin testing breakpoints
+$STASM test-int.sta
+A=0; $STEM --dump a.sth a.stb || A=$?
+B=0; printf 'continue\n' | $STEM --break 0x3009 --break 0x13009 --dump b.sth a.stb > out.txt || B=$?
+[ $A -eq $B ]
+cmp a.sth b.sth
+grep -q "bp hit on core 0 at address 0x3009" out.txt
+rm out.txt
+# Engines run at full speed to pages which may hold breakpoints, so check that
+# each stops at the same pc, here in a block which crosses onto such a page
+$STASM test-smc.sta
+printf 'continue\ncontinue\nreg\nquit\n' | $STEM --break 0x4009 --dump a.sth a.stb > a.txt
+grep -q "pc:  0x0000000000004009" a.txt
+for ENGINE in threaded block jit; do
+	printf 'continue\ncontinue\nreg\nquit\n' | $STEM --engine=$ENGINE --jit-threshold=1 --break 0x4009 --dump b.sth a.stb > b.txt
+	cmp a.txt b.txt
+	cmp a.sth b.sth
+done
+rm a.txt b.txt
 
 test_end
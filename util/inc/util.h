@@ -3,24 +3,103 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
+
+// Whether the host stores integers in little-endian order, so that the conversions
+// below are plain copies which compile to single loads and stores
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define UTIL_LITTLE_ENDIAN 1
+#else
+#define UTIL_LITTLE_ENDIAN 0
+#endif
 
 // Put the given 16-bit value into the given byte array in little-endian order
-void put_little16(uint16_t val, uint8_t *data);
+static inline void put_little16(uint16_t val, uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	memcpy(data, &val, sizeof(val));
+#else
+	data[0] = val;
+	data[1] = val >> 8;
+#endif
+}
 
 // Put the given 32-bit value into the given byte array in little-endian order
-void put_little32(uint32_t val, uint8_t *data);
+static inline void put_little32(uint32_t val, uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	memcpy(data, &val, sizeof(val));
+#else
+	data[0] = val;
+	data[1] = val >> 8;
+	data[2] = val >> 16;
+	data[3] = val >> 24;
+#endif
+}
 
 // Put the given 64-bit value into the given byte array in little-endian order
-void put_little64(uint64_t val, uint8_t *data);
+static inline void put_little64(uint64_t val, uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	memcpy(data, &val, sizeof(val));
+#else
+	data[0] = val;
+	data[1] = val >> 8;
+	data[2] = val >> 16;
+	data[3] = val >> 24;
+	data[4] = val >> 32;
+	data[5] = val >> 40;
+	data[6] = val >> 48;
+	data[7] = val >> 56;
+#endif
+}
 
 // Returns the 16-bit value represented by the array of two bytes in little-endian order
-uint16_t get_little16(const uint8_t *data);
+static inline uint16_t get_little16(const uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	uint16_t val;
+	memcpy(&val, data, sizeof(val));
+	return val;
+#else
+	return (uint16_t)data[0] |
+		((uint16_t)data[1] << 8);
+#endif
+}
 
-// Returns the 32-bit value represented by the array of two bytes in little-endian order
-uint32_t get_little32(const uint8_t *data);
+// Returns the 32-bit value represented by the array of four bytes in little-endian order
+static inline uint32_t get_little32(const uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	uint32_t val;
+	memcpy(&val, data, sizeof(val));
+	return val;
+#else
+	return (uint32_t)data[0] |
+		((uint32_t)data[1] << 8) |
+		((uint32_t)data[2] << 16) |
+		((uint32_t)data[3] << 24);
+#endif
+}
 
-// Returns the 64-bit value represented by the array of two bytes in little-endian order
-uint64_t get_little64(const uint8_t *data);
+// Returns the 64-bit value represented by the array of eight bytes in little-endian order
+static inline uint64_t get_little64(const uint8_t *data)
+{
+#if UTIL_LITTLE_ENDIAN
+	uint64_t val;
+	memcpy(&val, data, sizeof(val));
+	return val;
+#else
+	return (uint64_t)data[0] |
+		((uint64_t)data[1] << 8) |
+		((uint64_t)data[2] << 16) |
+		((uint64_t)data[3] << 24) |
+		((uint64_t)data[4] << 32) |
+		((uint64_t)data[5] << 40) |
+		((uint64_t)data[6] << 48) |
+		((uint64_t)data[7] << 56);
+#endif
+}
 
 // Returns the minimum number of bytes required to represent the given value
 int min_bytes_for_val(int64_t val);